@@ -0,0 +1,148 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "affinity.h"
+
+static thread_local int thread_numa_node = -1;
+
+// Parse the list format of sysfs, like "0-3,8-11".
+static std::vector<int> parse_cpu_list(std::string list) {
+    std::vector<int> out;
+    std::istringstream ss{list};
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = first;
+        if (dash != std::string::npos) {
+            last = std::stoi(range.substr(dash+1));
+        }
+        for (int c = first; c <= last; ++c) {
+            out.emplace_back(c);
+        }
+    }
+    return out;
+}
+
+static std::string read_line(std::string filename) {
+    std::ifstream file{filename};
+    std::string line;
+    if (file.is_open()) {
+        std::getline(file, line);
+    }
+    return line;
+}
+
+Affinity &Affinity::get() {
+    static Affinity affinity;
+    return affinity;
+}
+
+Affinity::Affinity() {
+    const std::string sysfs = "/sys/devices/system";
+    auto online = parse_cpu_list(read_line(sysfs + "/cpu/online"));
+
+    if (online.empty()) {
+        int num_cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (int c = 0; c < num_cpus; ++c) {
+            online.emplace_back(c);
+        }
+    }
+
+    for (int c : online) {
+        auto package = read_line(sysfs + "/cpu/cpu" + std::to_string(c) +
+                                     "/topology/physical_package_id");
+        int socket = package.empty() ? 0 : std::max(0, std::stoi(package));
+        m_cpus.emplace_back(Cpu{c, socket, 0});
+        m_num_sockets = std::max(m_num_sockets, socket+1);
+    }
+
+    auto nodes = parse_cpu_list(read_line(sysfs + "/node/online"));
+    for (int n : nodes) {
+        auto cpus = parse_cpu_list(read_line(sysfs + "/node/node" +
+                                                 std::to_string(n) + "/cpulist"));
+        for (auto &cpu : m_cpus) {
+            if (std::find(std::begin(cpus), std::end(cpus), cpu.id) != std::end(cpus)) {
+                cpu.numa_node = n;
+            }
+        }
+        m_num_numa_nodes = std::max(m_num_numa_nodes, n+1);
+    }
+
+    std::stable_sort(std::begin(m_cpus), std::end(m_cpus),
+                         [](const Cpu &a, const Cpu &b) {
+                             return a.socket < b.socket;
+                         });
+}
+
+std::string Affinity::bind_thread(int thread_idx, mode_t mode) {
+    std::ostringstream out;
+    std::vector<Cpu> bound;
+
+    if (mode == CORE) {
+        bound.emplace_back(m_cpus[thread_idx % m_cpus.size()]);
+    } else if (mode == SOCKET) {
+        const int socket = thread_idx % m_num_sockets;
+        for (const auto &cpu : m_cpus) {
+            if (cpu.socket == socket) {
+                bound.emplace_back(cpu);
+            }
+        }
+    }
+
+    if (bound.empty()) {
+        return "not bound";
+    }
+
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (const auto &cpu : bound) {
+        CPU_SET(cpu.id, &cpuset);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+        return "fail to bind";
+    }
+#else
+    return "not supported";
+#endif
+
+    // All cpus of one socket share the same NUMA node in general.
+    thread_numa_node = bound[0].numa_node;
+
+    if (mode == CORE) {
+        out << "cpu " << bound[0].id;
+    } else {
+        out << bound.size() << " cpu(s)";
+    }
+    out << ", socket " << bound[0].socket
+            << ", node " << bound[0].numa_node;
+    return out.str();
+}
+
+int Affinity::get_num_cpus() const {
+    return m_cpus.size();
+}
+
+int Affinity::get_num_sockets() const {
+    return m_num_sockets;
+}
+
+int Affinity::get_num_numa_nodes() const {
+    return m_num_numa_nodes;
+}
+
+int Affinity::get_thread_numa_node() {
+    return thread_numa_node;
+}
@@ -0,0 +1,45 @@
+#ifndef AFFINITY_H_INCLUDE
+#define AFFINITY_H_INCLUDE
+
+#include <vector>
+#include <string>
+
+class Affinity {
+public:
+    enum mode_t {
+        NONE = 0,   // Let the OS place the threads.
+        CORE = 1,   // Pin every thread to one core, fill a socket first.
+        SOCKET = 2  // Pin every thread to all cores of one socket, round-robin.
+    };
+
+    static Affinity &get();
+
+    // Bind the current thread by its index and remember its NUMA node.
+    // Return the description of the placement.
+    std::string bind_thread(int thread_idx, mode_t mode);
+
+    int get_num_cpus() const;
+    int get_num_sockets() const;
+    int get_num_numa_nodes() const;
+
+    // The NUMA node of the current thread. It is -1 if the thread is
+    // not bound.
+    static int get_thread_numa_node();
+
+private:
+    Affinity();
+
+    struct Cpu {
+        int id;
+        int socket;
+        int numa_node;
+    };
+
+    // The cpus sorted by socket, then by id.
+    std::vector<Cpu> m_cpus;
+
+    int m_num_sockets{1};
+    int m_num_numa_nodes{1};
+};
+
+#endif
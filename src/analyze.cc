@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "analyze.h"
+#include "game_state.h"
+#include "search.h"
+#include "config.h"
+#include "sgf.h"
+
+// The moves shown per position.
+#define ANALYZE_TOP_MOVES (5)
+
+// Below this budget one position can not use many threads well, so the
+// threads search the different positions instead.
+#define ANALYZE_SMALL_PLAYOUTS (10000)
+
+static int text_to_vertex(const GameState &state, std::string text) {
+    if (text.size() < 2 || !std::isalpha(text[0])) {
+        return Board::NULL_VERTEX;
+    }
+    int x = std::toupper(text[0]) - 'A';
+    if (x >= 8) x--; // skip I
+    int y = std::atoi(text.substr(1).c_str()) - 1;
+
+    const int board_size = state.get_board_size();
+    if (x < 0 || y < 0 || x >= board_size || y >= board_size) {
+        return Board::NULL_VERTEX;
+    }
+    return state.get_vertex(x, y);
+}
+
+static std::string vertex_to_text(const GameState &state, int vtx) {
+    const char *x_lable_map = "ABCDEFGHJKLMNOPQRST";
+    std::string out;
+    out += x_lable_map[state.get_x(vtx)];
+    out += std::to_string(state.get_y(vtx)+1);
+    return out;
+}
+
+// Set up the position of the line. Return the error or an empty string.
+static std::string setup_position(GameState &state, std::string line) {
+    std::istringstream ss{line};
+    std::string token;
+    std::vector<std::array<int, 2>> hollow_pos = cfg_hollow_pos;
+    std::vector<std::string> moves;
+    std::vector<std::string> *target = nullptr;
+    std::vector<std::string> hollow_texts;
+
+    while (ss >> token) {
+        if (token == "hollow") {
+            hollow_pos.clear();
+            target = &hollow_texts;
+        } else if (token == "moves") {
+            target = &moves;
+        } else if (target) {
+            target->emplace_back(token);
+        } else {
+            return "unknown token " + token;
+        }
+    }
+
+    // The vertices are parsed on an empty board first.
+    state.clear_board(Board::BOARD_SIZE, 0.f, {});
+    for (const auto &text : hollow_texts) {
+        const int vtx = text_to_vertex(state, text);
+        if (vtx == Board::NULL_VERTEX) {
+            return "bad hollow " + text;
+        }
+        hollow_pos.push_back({state.get_x(vtx), state.get_y(vtx)});
+    }
+
+    state.clear_board(Board::BOARD_SIZE, 0.f, hollow_pos);
+    for (const auto &text : moves) {
+        const int vtx = text_to_vertex(state, text);
+        if (vtx == Board::NULL_VERTEX ||
+                !state.play_move(vtx, state.get_tomove())) {
+            return "illegal move " + text;
+        }
+    }
+    return std::string{};
+}
+
+static std::string analyze_position(GameState &state, Search &search,
+                                        int line_idx, std::string line) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4);
+    out << "{\"line\": " << line_idx;
+
+    auto error = setup_position(state, line);
+    if (!error.empty()) {
+        out << ", \"error\": \"" << error << "\"}";
+        return out.str();
+    }
+
+    const int color = state.get_tomove();
+    out << ", \"tomove\": \"" << (color == Board::BLACK ? "B" : "W") << "\"";
+
+    if (state.get_legal_moves(color).empty()) {
+        out << ", \"gameover\": true, \"moves\": []}";
+        return out.str();
+    }
+
+    // The worker takes any line, so the tree of its last line is not
+    // reused. Otherwise the result would depend on the order of lines.
+    search.release_tree();
+    auto stats = search.subsearch(cfg_playouts, std::numeric_limits<int>::max());
+    std::stable_sort(std::begin(stats), std::end(stats),
+                         [](const RootStat &a, const RootStat &b) {
+                             return a.visits > b.visits;
+                         });
+
+    auto get_winrate = [color](int visits, int black_wins) {
+        const double black_eval = (double)black_wins / std::max(visits, 1);
+        return color == Board::BLACK ? black_eval : 1. - black_eval;
+    };
+
+    int visits = 0;
+    int black_wins = 0;
+    for (const auto &stat : stats) {
+        visits += stat.visits;
+        black_wins += stat.black_wins;
+    }
+    out << ", \"visits\": " << visits
+            << ", \"winrate\": " << get_winrate(visits, black_wins)
+            << ", \"moves\": [";
+
+    const int size = std::min((int)stats.size(), ANALYZE_TOP_MOVES);
+    for (int i = 0; i < size; ++i) {
+        out << (i == 0 ? "" : ", ")
+                << "{\"move\": \"" << vertex_to_text(state, stats[i].vertex) << "\", "
+                << "\"visits\": " << stats[i].visits << ", "
+                << "\"winrate\": " << get_winrate(stats[i].visits, stats[i].black_wins) << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+// Write the game in the form of the input lines. The moves of the
+// line alternate, so a game which does not is reported as illegal.
+static std::string sgf_game_to_line(const SgfGame &game) {
+    const char *x_lable_map = "ABCDEFGHJKLMNOPQRST";
+    auto to_text = [x_lable_map](int x, int y) {
+        return x_lable_map[x] + std::to_string(y+1);
+    };
+
+    std::ostringstream out;
+    if (game.has_hollow) {
+        out << "hollow";
+        for (const auto &pos : game.hollow_pos) {
+            out << ' ' << to_text(pos[0], pos[1]);
+        }
+        out << ' ';
+    }
+    out << "moves";
+    int color = Board::BLACK;
+    for (const auto &move : game.moves) {
+        if (move.x < 0 || move.color != color) {
+            out << " ?";
+            break;
+        }
+        out << ' ' << to_text(move.x, move.y);
+        color = !color;
+    }
+    return out.str();
+}
+
+// Return true if the output line is one whole result of
+// analyze_position(). The braces and the brackets out of the strings
+// must close exactly at the end, and the result must end with its
+// moves or its error.
+static bool is_complete_result(const std::string &line, int &line_idx) {
+    const std::string key = "{\"line\": ";
+    if (line.compare(0, key.size(), key) != 0) {
+        return false;
+    }
+    char *end = nullptr;
+    line_idx = std::strtol(line.c_str() + key.size(), &end, 10);
+    if (end == line.c_str() + key.size() || (*end != ',' && *end != '}')) {
+        return false;
+    }
+
+    int depth = 0;
+    bool in_string = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+        if (in_string) {
+            in_string = (c != '"');
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0 && i + 1 != line.size()) {
+                return false;
+            }
+        }
+    }
+    if (in_string || depth != 0) {
+        return false;
+    }
+
+    const bool has_moves = line.size() >= 2 &&
+                               line.compare(line.size() - 2, 2, "]}") == 0;
+    const bool has_error = line.find("\"error\": \"") != std::string::npos &&
+                               line.compare(line.size() - 2, 2, "\"}") == 0;
+    return has_moves || has_error;
+}
+
+// Collect the lines which are already analyzed. A partly written last
+// line, which does not end with the newline, is ignored and analyzed
+// again. The newline tells if the file ends with the newline.
+static std::unordered_set<int> get_finished_lines(std::string output, bool &newline) {
+    std::unordered_set<int> finished;
+    std::ifstream file{output, std::ios::binary};
+    std::string line;
+
+    newline = true;
+    while (std::getline(file, line)) {
+        if (file.eof()) {
+            // The last line has no newline.
+            newline = false;
+            break;
+        }
+        int line_idx;
+        if (is_complete_result(line, line_idx)) {
+            finished.insert(line_idx);
+        }
+    }
+    return finished;
+}
+
+void run_analyze(std::string input, std::string output) {
+    const bool is_sgf = input.size() >= 4 &&
+                            input.compare(input.size() - 4, 4, ".sgf") == 0;
+    std::unique_ptr<SgfReader> sgf_reader;
+    std::ifstream input_file;
+    if (is_sgf) {
+        sgf_reader = std::make_unique<SgfReader>(input);
+    } else {
+        input_file.open(input);
+    }
+    if (is_sgf ? !sgf_reader->is_open() : !input_file.is_open()) {
+        fprintf(stderr, "Fail to open the analysis input %s.\n", input.c_str());
+        return;
+    }
+
+    std::unordered_set<int> finished;
+    std::ofstream output_file;
+    if (!output.empty()) {
+        // Start a new line after the partly written one.
+        bool newline = true;
+        finished = get_finished_lines(output, newline);
+
+        output_file.open(output, std::ios::app);
+        if (output_file.is_open() && !newline) {
+            output_file << std::endl;
+        }
+        if (!output_file.is_open()) {
+            fprintf(stderr, "Fail to open the analysis output %s.\n", output.c_str());
+            return;
+        }
+        if (!finished.empty()) {
+            fprintf(stderr, "Resume after %zu analyzed position(s).\n", finished.size());
+        }
+    }
+    std::ostream &out = output.empty() ? std::cout : output_file;
+
+    int workers = cfg_analyze_workers;
+    if (workers <= 0) {
+        workers = cfg_playouts < ANALYZE_SMALL_PLAYOUTS ? cfg_search_threads : 1;
+    }
+    workers = std::max(workers, 1);
+    SearchParameters parameters;
+    parameters.threads = std::max(cfg_search_threads / workers, 1);
+
+    // The workers read the input one line at a time, so only the
+    // positions in progress are in memory.
+    std::mutex input_mutex;
+    std::mutex output_mutex;
+    int next_line = 0;
+
+    auto worker = [&]() {
+        GameState state;
+        state.clear_board(Board::BOARD_SIZE, 0.f);
+        Search search(state, parameters);
+
+        while (true) {
+            std::string line;
+            int line_idx;
+            {
+                std::lock_guard<std::mutex> lock(input_mutex);
+                if (is_sgf) {
+                    SgfGame game;
+                    if (!sgf_reader->next_game(game)) {
+                        break;
+                    }
+                    line = sgf_game_to_line(game);
+                } else if (!std::getline(input_file, line)) {
+                    break;
+                }
+                line_idx = next_line++;
+            }
+            if (line.empty() || line[0] == '#' || finished.count(line_idx)) {
+                continue;
+            }
+
+            auto result = analyze_position(state, search, line_idx, line);
+
+            std::lock_guard<std::mutex> lock(output_mutex);
+            out << result << std::endl;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef ANALYZE_H_INCLUDE
+#define ANALYZE_H_INCLUDE
+
+#include <string>
+
+// Analyze the positions of the input file and write one JSON line per
+// position. Every input line is
+//
+//     [hollow <vertex> ...] moves <vertex> ...
+//
+// where the moves alternate from black. Without the hollow part the
+// default layout is used. The lines starting with # are skipped. If
+// the input file ends with .sgf, every game of the file is one position
+// at its last move, and its index is the line. If
+// the output file already has results, their lines are skipped and the
+// new results are appended, so an interrupted run can be resumed.
+void run_analyze(std::string input, std::string output);
+
+#endif
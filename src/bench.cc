@@ -0,0 +1,239 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "bench.h"
+#include "game_state.h"
+#include "search.h"
+#include "random.h"
+#include "time_manager.h"
+#include "sharded_counter.h"
+#include "config.h"
+
+// Every measurement runs for BENCH_SECONDS.
+#define BENCH_SECONDS (1.0)
+
+// The positions are built from a fixed seed so that every run measures
+// the same boards.
+#define BENCH_SEED (5566)
+
+// The increments per thread of the counter benchmark.
+#define BENCH_COUNTER_ADDS (1 << 22)
+
+struct BenchPosition {
+    std::string name;
+    GameState state;
+};
+
+// Play the random moves with our own generator until the side to move
+// has at most min_legal_moves moves or max_moves are played.
+static void play_random_moves(GameState &state, PRNG &rng,
+                                  int max_moves, int min_legal_moves) {
+    for (int i = 0; i < max_moves; ++i) {
+        const int color = state.get_tomove();
+        auto legal_moves = state.get_legal_moves(color);
+        if ((int)legal_moves.size() <= min_legal_moves) {
+            break;
+        }
+        state.play_move(legal_moves[rng() % legal_moves.size()], color);
+    }
+}
+
+static std::vector<BenchPosition> get_bench_positions() {
+    std::vector<BenchPosition> positions;
+    PRNG rng(BENCH_SEED);
+
+    positions.emplace_back(BenchPosition{"empty", GameState{}});
+    positions.back().state.clear_board(Board::BOARD_SIZE, 0.f, {});
+
+    positions.emplace_back(BenchPosition{"hollow", GameState{}});
+    positions.back().state.clear_board(Board::BOARD_SIZE, 0.f, cfg_hollow_pos);
+
+    positions.emplace_back(BenchPosition{"midgame", positions.back().state});
+    play_random_moves(positions.back().state, rng, 20, 0);
+
+    positions.emplace_back(BenchPosition{"endgame", positions.back().state});
+    play_random_moves(positions.back().state, rng, Board::NUM_INTESECTIONS, 8);
+
+    return positions;
+}
+
+// Run the function until BENCH_SECONDS passed. Return the calls per
+// second.
+static double measure_rate(std::function<int()> func) {
+    Time start;
+    long long count = 0;
+    double elapsed = 0;
+
+    do {
+        for (int i = 0; i < 16; ++i) {
+            count += func();
+        }
+        elapsed = Time::timediff_seconds(start, Time());
+    } while (elapsed < BENCH_SECONDS);
+
+    return count / elapsed;
+}
+
+static double bench_legal_moves(GameState &state) {
+    const int color = state.get_tomove();
+    return measure_rate([&state, color]() {
+        return (int)!state.get_legal_moves(color).empty();
+    });
+}
+
+static double bench_play_moves(GameState &state) {
+    // Prepare one random continuation, then replay it on the copies
+    // of the board.
+    PRNG rng(BENCH_SEED);
+    GameState fork_state = state;
+    std::vector<int> moves;
+    for (int i = 0; i < 8; ++i) {
+        const int color = fork_state.get_tomove();
+        auto legal_moves = fork_state.get_legal_moves(color);
+        if (legal_moves.empty()) {
+            break;
+        }
+        moves.emplace_back(legal_moves[rng() % legal_moves.size()]);
+        fork_state.play_move_fast(moves.back(), color);
+    }
+    if (moves.empty()) {
+        return 0;
+    }
+
+    const Board &base = state.board;
+    return measure_rate([&base, &moves]() {
+        Board board = base;
+        for (int vtx : moves) {
+            board.play_move_assume_legal(vtx, board.get_tomove());
+        }
+        return (int)moves.size();
+    });
+}
+
+static double bench_rollouts(GameState &state, int stop_margin=0) {
+    return measure_rate([&state, stop_margin]() {
+        state.rollouts(stop_margin);
+        return 1;
+    });
+}
+
+static double bench_static_evals(GameState &state) {
+    return measure_rate([&state]() {
+        state.static_eval();
+        return 1;
+    });
+}
+
+static double bench_playouts(GameState &state, int threads,
+                                 int static_eval=STATIC_EVAL_NONE) {
+    SearchParameters parameters;
+    parameters.threads = threads;
+    parameters.static_eval = static_eval;
+
+    GameState root_state = state;
+    Search search(root_state, parameters);
+
+    Time start;
+    search.subsearch(std::numeric_limits<int>::max(), (int)(100 * BENCH_SECONDS));
+    const double elapsed = Time::timediff_seconds(start, Time());
+
+    return search.get_playouts() / elapsed;
+}
+
+// Let the threads add to one shared atomic or to their own shards of a
+// sharded counter, like the playout counter of the search. Return the
+// increments per second.
+static double bench_counter(int threads, bool sharded) {
+    std::atomic<int> shared{0};
+    ShardedCounter counter;
+    counter.resize(threads);
+
+    Time start;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&shared, &counter, sharded, t]() {
+            for (int i = 0; i < BENCH_COUNTER_ADDS; ++i) {
+                if (sharded) {
+                    counter.add(t, 1);
+                } else {
+                    shared.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+    const double elapsed = Time::timediff_seconds(start, Time());
+
+    return (double)threads * BENCH_COUNTER_ADDS / std::max(elapsed, 1e-6);
+}
+
+void run_bench() {
+    auto positions = get_bench_positions();
+
+    std::vector<int> thread_counts;
+    for (int t = 1; t < cfg_search_threads; t *= 2) {
+        thread_counts.emplace_back(t);
+    }
+    thread_counts.emplace_back(std::max(cfg_search_threads, 1));
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "{\"bench_seconds\": " << BENCH_SECONDS
+            << ", \"positions\": [";
+
+    for (size_t i = 0; i < positions.size(); ++i) {
+        auto &position = positions[i];
+        auto &state = position.state;
+        fprintf(cfg_search_file, "Bench the %s position.\n", position.name.c_str());
+
+        const double legal_moves_rate = bench_legal_moves(state);
+        const double play_move_rate = bench_play_moves(state);
+        const double rollouts_rate = bench_rollouts(state);
+        const double stopped_rollouts_rate = bench_rollouts(state, cfg_static_margin);
+        const double static_evals_rate = bench_static_evals(state);
+
+        out << (i == 0 ? "" : ", ") << "{"
+                << "\"name\": \"" << position.name << "\", "
+                << "\"moves\": " << state.get_movenum() << ", "
+                << "\"legal_moves\": "
+                << state.get_legal_moves(state.get_tomove()).size() << ", "
+                << "\"legal_move_generation_per_sec\": " << legal_moves_rate << ", "
+                << "\"play_move_per_sec\": " << play_move_rate << ", "
+                << "\"rollouts_per_sec\": " << rollouts_rate << ", "
+                << "\"stopped_rollouts_per_sec\": " << stopped_rollouts_rate << ", "
+                << "\"static_evals_per_sec\": " << static_evals_rate << ", "
+                << "\"playouts_per_sec\": {";
+
+        for (size_t t = 0; t < thread_counts.size(); ++t) {
+            const double playouts_rate = bench_playouts(state, thread_counts[t]);
+            out << (t == 0 ? "" : ", ")
+                    << "\"" << thread_counts[t] << "\": " << playouts_rate;
+        }
+        out << "}, \"static_eval_playouts_per_sec\": {"
+                << "\"stop\": " << bench_playouts(state, 1, STATIC_EVAL_STOP) << ", "
+                << "\"value\": " << bench_playouts(state, 1, STATIC_EVAL_VALUE) << "}}";
+    }
+    out << "], \"counter_adds_per_sec\": {";
+    for (int sharded = 0; sharded <= 1; ++sharded) {
+        out << (sharded ? ", \"sharded\": {" : "\"shared\": {");
+        for (size_t t = 0; t < thread_counts.size(); ++t) {
+            const double adds_rate = bench_counter(thread_counts[t], sharded);
+            out << (t == 0 ? "" : ", ")
+                    << "\"" << thread_counts[t] << "\": " << adds_rate;
+        }
+        out << "}";
+    }
+    out << "}}";
+
+    std::cout << out.str() << std::endl;
+}
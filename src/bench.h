@@ -0,0 +1,10 @@
+#ifndef BENCH_H_INCLUDE
+#define BENCH_H_INCLUDE
+
+// Measure the board, rollout and search throughput on a fixed set of
+// positions and print the report as JSON to stdout. The search is
+// measured at 1, 2, 4, ... up to cfg_search_threads threads, and with
+// the static evaluation modes at one thread.
+void run_bench();
+
+#endif
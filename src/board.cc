@@ -4,6 +4,7 @@
 #include <functional>
 
 #include "board.h"
+#include "hash.h"
 #include "config.h"
 
 constexpr int Board::BOARD_SIZE;
@@ -15,6 +16,11 @@ constexpr int Board::RESIGN;
 constexpr int Board::NULL_VERTEX;
 
 void Board::reset_board(int board_size) {
+    reset_board(board_size, cfg_hollow_pos);
+}
+
+void Board::reset_board(int board_size,
+                            const std::vector<std::array<int, 2>> &hollow_pos) {
     m_board_size = std::min(board_size, BOARD_SIZE);
 
     const int x_shift = m_board_size+2;
@@ -39,15 +45,18 @@ void Board::reset_board(int board_size) {
         }
     }
 
-    int hollow_size = cfg_hollow_pos.size();
+    int hollow_size = hollow_pos.size();
     for (int i = 0; i < hollow_size; ++i) {
-        int x = cfg_hollow_pos[i][0];
-        int y = cfg_hollow_pos[i][1];
+        int x = hollow_pos[i][0];
+        int y = hollow_pos[i][1];
         if (x < m_board_size && y < m_board_size) {
             m_state[get_vertex(x,y)] = INVLD;
         }
     }
 
+    m_tomove = BLACK;
+    m_last_move = NULL_VERTEX;
+    m_komove = NULL_VERTEX;
     m_passes = 0; // unused
 }
 
@@ -322,6 +331,30 @@ int Board::compute_reach_color(int color) const {
     return reachable;
 }
 
+void Board::compute_exclusive_moves(int &black_only, int &white_only, int &both) const {
+    black_only = 0;
+    white_only = 0;
+    both = 0;
+
+    for (int y = 0; y < m_board_size; ++y) {
+        for (int x = 0; x < m_board_size; ++x) {
+            const int vtx = get_vertex(x, y);
+            if (m_state[vtx] != EMPTY) {
+                continue;
+            }
+            const bool black = legal_move(vtx, BLACK);
+            const bool white = legal_move(vtx, WHITE);
+            if (black && white) {
+                ++both;
+            } else if (black) {
+                ++black_only;
+            } else if (white) {
+                ++white_only;
+            }
+        }
+    }
+}
+
 std::string Board::to_string() const {
     std::ostringstream ss;
 
@@ -376,6 +409,10 @@ int Board::get_passes() const {
     return m_passes;
 }
 
+int Board::get_liberties(int vtx) const {
+    return m_liberties[m_parent[vtx]];
+}
+
 int Board::get_state(int vtx) const {
     return m_state[vtx];
 }
@@ -390,7 +427,7 @@ std::uint64_t Board::compute_hash() const {
         str[vtx] = state_map[m_state[vtx]];
     }
 
-    return std::hash<std::string>{}(str);
+    return fnv1a_hash(str);
 }
 
 int Board::get_index(int x, int y) const {
@@ -2,6 +2,7 @@
 #define BOARD_H_INCLUDE
 
 #include <array>
+#include <vector>
 #include <cstdint>
 
 class Board {
@@ -27,12 +28,20 @@ public:
 
     void reset_board(int board_size);
 
+    // Reset the board with the given hollow points instead of the
+    // cfg_hollow_pos.
+    void reset_board(int board_size,
+                         const std::vector<std::array<int, 2>> &hollow_pos);
+
     void play_move_assume_legal(int vtx, int color);
 
     bool legal_move(int vtx, int color) const;
 
     int compute_reach_color(int color) const;
 
+    // Classify the empty points by the colors which can play them.
+    void compute_exclusive_moves(int &black_only, int &white_only, int &both) const;
+
     bool is_eyeshape(int vtx, int color) const;
 
     std::string to_string() const;
@@ -46,6 +55,9 @@ public:
     int get_board_size() const;
     int get_passes() const;
 
+    // Get the liberties of the string at the vertex.
+    int get_liberties(int vtx) const;
+
     void set_to_move(int color);
 
     std::uint64_t compute_hash() const;
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "book.h"
+#include "hash.h"
+#include "search.h"
+#include "symmetry.h"
+
+// The moves followed from every book position.
+#define BOOK_BRANCHES (3)
+
+// The version 2 keys are the FNV-1a hash.
+#define BOOK_VERSION (2)
+
+namespace {
+
+struct BookHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t board_size;
+    std::uint32_t padding;
+    std::uint64_t num_entries;
+};
+
+// The move is the index of the canonical position.
+struct BookEntry {
+    std::uint64_t key;
+    std::int32_t move;
+    std::int32_t visits;
+    float winrate;
+    std::int32_t padding;
+};
+
+std::uint64_t compute_symmetry_hash(const GameState &state, int symmetry) {
+    const char state_map[4] = {'x','o','.', '-'};
+    const int board_size = state.get_board_size();
+    std::string str(board_size * board_size + 1, state_map[Board::INVLD]);
+
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            int tx = x, ty = y;
+            transform_symmetry(symmetry, board_size, tx, ty);
+            str[state.get_index(tx, ty)] = state_map[state.get_state(state.get_vertex(x, y))];
+        }
+    }
+    str.back() = state.get_tomove() == Board::BLACK ? 'b' : 'w';
+
+    return fnv1a_hash(str);
+}
+
+// Return the minimal hash over the symmetries and its symmetry.
+std::uint64_t compute_canonical_hash(const GameState &state, int &symmetry) {
+    std::uint64_t key = std::numeric_limits<std::uint64_t>::max();
+    symmetry = 0;
+    for (int s = 0; s < NUM_SYMMETRIES; ++s) {
+        const auto hash = compute_symmetry_hash(state, s);
+        if (hash < key) {
+            key = hash;
+            symmetry = s;
+        }
+    }
+    return key;
+}
+
+int to_canonical_move(const GameState &state, int vtx, int symmetry) {
+    int x = state.get_x(vtx);
+    int y = state.get_y(vtx);
+    transform_symmetry(symmetry, state.get_board_size(), x, y);
+    return state.get_index(x, y);
+}
+
+int from_canonical_move(const GameState &state, int move, int symmetry) {
+    const int board_size = state.get_board_size();
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            int tx = x, ty = y;
+            transform_symmetry(symmetry, board_size, tx, ty);
+            if (state.get_index(tx, ty) == move) {
+                return state.get_vertex(x, y);
+            }
+        }
+    }
+    return Board::NULL_VERTEX;
+}
+
+std::string vertex_to_text(const GameState &state, int vtx) {
+    const char *x_lable_map = "ABCDEFGHJKLMNOPQRST";
+    std::string out;
+    out += x_lable_map[state.get_x(vtx)];
+    out += std::to_string(state.get_y(vtx)+1);
+    return out;
+}
+
+} // namespace
+
+Book &Book::get() {
+    static Book book;
+    return book;
+}
+
+Book::~Book() {
+    if (m_map) {
+        munmap(m_map, m_map_size);
+    }
+}
+
+bool Book::load(std::string filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(cfg_search_file, "Fail to open the book %s.\n", filename.c_str());
+        return false;
+    }
+
+    bool success = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (std::size_t)st.st_size >= sizeof(BookHeader)) {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            const auto header = static_cast<const BookHeader *>(addr);
+            const std::size_t num_entries = header->num_entries;
+            if (std::memcmp(header->magic, "NGBK", 4) == 0 &&
+                    header->version == BOOK_VERSION &&
+                    header->board_size == (std::uint32_t)Board::BOARD_SIZE &&
+                    sizeof(BookHeader) + num_entries * sizeof(BookEntry) <= (std::size_t)st.st_size) {
+                m_map = addr;
+                m_map_size = st.st_size;
+                m_entries = header + 1;
+                m_num_entries = num_entries;
+                success = true;
+            } else {
+                munmap(addr, st.st_size);
+            }
+        }
+    }
+    close(fd);
+
+    if (success) {
+        fprintf(cfg_search_file, "Load %zu book entries.\n", m_num_entries);
+    } else {
+        fprintf(cfg_search_file, "The book %s is broken.\n", filename.c_str());
+    }
+    return success;
+}
+
+int Book::probe(const GameState &state) const {
+    if (m_num_entries == 0) {
+        return Board::NULL_VERTEX;
+    }
+
+    int symmetry;
+    const auto key = compute_canonical_hash(state, symmetry);
+
+    const auto entries = static_cast<const BookEntry *>(m_entries);
+    const auto end = entries + m_num_entries;
+    const auto ite = std::lower_bound(entries, end, key,
+                                          [](const BookEntry &e, std::uint64_t k) {
+                                              return e.key < k;
+                                          });
+    if (ite == end || ite->key != key) {
+        return Board::NULL_VERTEX;
+    }
+
+    // The hash may collide, so the move should be legal.
+    const int vtx = from_canonical_move(state, ite->move, symmetry);
+    if (vtx == Board::NULL_VERTEX ||
+            !state.board.legal_move(vtx, state.get_tomove())) {
+        return Board::NULL_VERTEX;
+    }
+    return vtx;
+}
+
+bool build_book(std::string filename, int depth) {
+    struct Position {
+        GameState state;
+        int ply;
+    };
+
+    std::vector<BookEntry> entries;
+    std::unordered_set<std::uint64_t> visited;
+    std::queue<Position> positions;
+
+    Position root;
+    root.state.clear_board(Board::BOARD_SIZE, 0.f);
+    root.ply = 0;
+    positions.emplace(root);
+
+    while (!positions.empty()) {
+        auto position = positions.front();
+        positions.pop();
+        auto &state = position.state;
+
+        int symmetry;
+        const auto key = compute_canonical_hash(state, symmetry);
+        if (!visited.insert(key).second) {
+            continue;
+        }
+
+        const int color = state.get_tomove();
+        if (state.is_gameover(color)) {
+            continue;
+        }
+
+        auto search_state = state;
+        Search search(search_state);
+        auto stats = search.subsearch(cfg_playouts, std::numeric_limits<int>::max());
+        std::sort(std::begin(stats), std::end(stats),
+                      [](const RootStat &a, const RootStat &b) {
+                          return a.visits > b.visits;
+                      });
+        if (stats.empty()) {
+            continue;
+        }
+
+        const auto &best = stats[0];
+        float winrate = (float)best.black_wins / std::max(best.visits, 1);
+        if (color == Board::WHITE) {
+            winrate = 1.f - winrate;
+        }
+        entries.emplace_back(BookEntry{
+            key, to_canonical_move(state, best.vertex, symmetry),
+            best.visits, winrate, 0});
+        fprintf(cfg_search_file, "Book position %zu, ply %d: %s, win-rate %.2f(%%).\n",
+                    entries.size(), position.ply,
+                    vertex_to_text(state, best.vertex).c_str(), 100 * winrate);
+
+        if (position.ply + 1 >= depth) {
+            continue;
+        }
+        const int branches = std::min((int)stats.size(), BOOK_BRANCHES);
+        for (int i = 0; i < branches; ++i) {
+            Position next{state, position.ply + 1};
+            next.state.play_move(stats[i].vertex, color);
+            positions.emplace(next);
+        }
+    }
+
+    std::sort(std::begin(entries), std::end(entries),
+                  [](const BookEntry &a, const BookEntry &b) {
+                      return a.key < b.key;
+                  });
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Fail to open the book %s.\n", filename.c_str());
+        return false;
+    }
+    BookHeader header{{'N', 'G', 'B', 'K'}, BOOK_VERSION,
+                          (std::uint32_t)Board::BOARD_SIZE, 0, entries.size()};
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!entries.empty()) {
+        success &= fwrite(entries.data(), sizeof(BookEntry), entries.size(), file) == entries.size();
+    }
+    success &= fclose(file) == 0;
+
+    fprintf(stderr, "Write %zu book entries to %s.\n", entries.size(), filename.c_str());
+    return success;
+}
@@ -0,0 +1,46 @@
+#ifndef BOOK_H_INCLUDE
+#define BOOK_H_INCLUDE
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+#include "config.h"
+#include "game_state.h"
+
+// The opening book. It is a sorted array of the best moves keyed by the
+// symmetry-canonical hash of the position, so the rotated and mirrored
+// openings share their entries. The hollow points are a part of the
+// position, so every layout has its own entries. The file is memory
+// mapped and searched in place.
+class Book {
+public:
+    static Book &get();
+
+    static bool enabled() {
+        return !cfg_book_file.empty();
+    }
+
+    bool load(std::string filename);
+
+    // Return the book move of the position, or NULL_VERTEX if the
+    // position is not covered.
+    int probe(const GameState &state) const;
+
+private:
+    Book() = default;
+    ~Book();
+
+    void *m_map{nullptr};
+    std::size_t m_map_size{0};
+    const void *m_entries{nullptr};
+    std::size_t m_num_entries{0};
+};
+
+// Search the opening positions of the current layout up to the given
+// plies with cfg_playouts playouts each and write the book. The best
+// BOOK_BRANCHES moves of every position are followed.
+bool build_book(std::string filename, int depth);
+
+#endif
@@ -3,11 +3,56 @@
 int cfg_node_expanding_thres = 8;
 int cfg_playouts = 10000;
 int cfg_search_threads = 1;
+int cfg_root_parallel_trees = 1;
+int cfg_root_share_interval = 0;
+int cfg_virtual_loss = 3;
+int cfg_virtual_loss_mode = VIRTUAL_LOSS_FIXED;
+int cfg_thread_affinity = 0;
+bool cfg_numa_arena = false;
+std::string cfg_master_address;
+std::string cfg_worker_address;
 float cfg_fpu_value = 5.0f;
 float cfg_c_uct = 1.0f;
 bool cfg_dump_analysis = false;
+bool cfg_bench = false;
+std::string cfg_analyze_input;
+std::string cfg_analyze_output;
+int cfg_analyze_workers = 0;
+bool cfg_server = false;
+std::string cfg_tree_cache_file;
+std::string cfg_book_file;
+int cfg_static_eval = STATIC_EVAL_NONE;
+int cfg_static_margin = 4;
+std::string cfg_nn_weights_file;
+bool cfg_nn_int8 = true;
+int cfg_nn_batch_size = 0;
+int cfg_widening_base = 0;
+int cfg_root_policy = ROOT_POLICY_UCT;
+int cfg_halving_candidates = 16;
+int cfg_selfplay_games = 0;
+std::string cfg_selfplay_output = "selfplay.bin";
+bool cfg_selfplay_compress = false;
+std::string cfg_training_dump;
+bool cfg_training_augment = false;
+std::string cfg_book_build_file;
+int cfg_book_depth = 4;
+int cfg_match_games = 0;
+int cfg_match_parallel = 1;
+std::string cfg_match_settings[2];
+float cfg_sprt_elo0 = 0.f;
+float cfg_sprt_elo1 = 20.f;
+std::uint64_t cfg_seed = 0;
+bool cfg_deterministic = false;
+bool cfg_profile_timers = false;
+std::string cfg_trace_file;
+int cfg_difftest_games = 0;
+int cfg_determinism_runs = 0;
 int cfg_lag_buffer = 1;
 int cfg_main_time = 7 * 24 * 60 * 60;
+int cfg_byo_time = 0;
+int cfg_byo_stones = 0;
+int cfg_byo_periods = 0;
+bool cfg_adaptive_time = true;
 bool cfg_enable_resign = true;
 FILE *cfg_search_file = stderr;
 std::vector<std::array<int, 2>> cfg_hollow_pos = {
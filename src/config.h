@@ -3,15 +3,74 @@
 
 #include <vector>
 #include <array>
+#include <cstdio>
+#include <string>
+#include <cstdint>
+
+#define VIRTUAL_LOSS_FIXED (0)
+#define VIRTUAL_LOSS_ADAPTIVE (1)
+#define VIRTUAL_LOSS_WU_UCT (2)
+
+#define STATIC_EVAL_NONE (0)
+#define STATIC_EVAL_STOP (1)
+#define STATIC_EVAL_VALUE (2)
+
+#define ROOT_POLICY_UCT (0)
+#define ROOT_POLICY_HALVING (1)
 
 extern int cfg_node_expanding_thres;
 extern int cfg_playouts;
 extern int cfg_search_threads;
+extern int cfg_root_parallel_trees;
+extern int cfg_root_share_interval;
+extern int cfg_virtual_loss;
+extern int cfg_virtual_loss_mode;
+extern int cfg_thread_affinity;
+extern bool cfg_numa_arena;
+extern std::string cfg_master_address;
+extern std::string cfg_worker_address;
 extern float cfg_fpu_value;
 extern float cfg_c_uct;
 extern bool cfg_dump_analysis;
+extern bool cfg_bench;
+extern std::string cfg_analyze_input;
+extern std::string cfg_analyze_output;
+extern int cfg_analyze_workers;
+extern bool cfg_server;
+extern std::string cfg_tree_cache_file;
+extern std::string cfg_book_file;
+extern int cfg_static_eval;
+extern int cfg_static_margin;
+extern std::string cfg_nn_weights_file;
+extern bool cfg_nn_int8;
+extern int cfg_nn_batch_size;
+extern int cfg_widening_base;
+extern int cfg_root_policy;
+extern int cfg_halving_candidates;
+extern int cfg_selfplay_games;
+extern std::string cfg_selfplay_output;
+extern bool cfg_selfplay_compress;
+extern std::string cfg_training_dump;
+extern bool cfg_training_augment;
+extern std::string cfg_book_build_file;
+extern int cfg_book_depth;
+extern int cfg_match_games;
+extern int cfg_match_parallel;
+extern std::string cfg_match_settings[2];
+extern float cfg_sprt_elo0;
+extern float cfg_sprt_elo1;
+extern std::uint64_t cfg_seed;
+extern bool cfg_deterministic;
+extern bool cfg_profile_timers;
+extern std::string cfg_trace_file;
+extern int cfg_difftest_games;
+extern int cfg_determinism_runs;
 extern int cfg_lag_buffer;
 extern int cfg_main_time;
+extern int cfg_byo_time;
+extern int cfg_byo_stones;
+extern int cfg_byo_periods;
+extern bool cfg_adaptive_time;
 extern bool cfg_enable_resign;
 extern FILE *cfg_search_file;
 extern std::vector<std::array<int, 2>> cfg_hollow_pos;
@@ -0,0 +1,369 @@
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "difftest.h"
+#include "hash.h"
+#include "board.h"
+#include "random.h"
+#include "config.h"
+
+// A straightforward backend which recomputes every string by flood
+// fill. It is slow but easy to trust. An optimized backend should
+// provide the same interface and can be checked by replacing it in
+// run_difftest().
+class FloodFillBoard {
+public:
+    void reset_board(int board_size) {
+        Board layout;
+        layout.reset_board(board_size);
+        m_board_size = layout.get_board_size();
+        for (int vtx = 0; vtx < Board::NUM_VERTICES; ++vtx) {
+            m_state[vtx] = layout.get_state(vtx);
+        }
+    }
+
+    // The capture and suicide are illegal in NoGo, so the stone is
+    // never removed.
+    void play_move_assume_legal(int vtx, int color) {
+        m_state[vtx] = color;
+    }
+
+    bool legal_move(int vtx, int color) const {
+        if (m_state[vtx] != Board::EMPTY) {
+            return false;
+        }
+        auto fork = *this;
+        fork.m_state[vtx] = color;
+        if (fork.get_liberties(vtx) == 0) {
+            return false;
+        }
+        for (int avtx : get_neighbors(vtx)) {
+            if (fork.m_state[avtx] == !color && fork.get_liberties(avtx) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int get_liberties(int vtx) const {
+        int liberties = 0;
+        std::vector<bool> marked(Board::NUM_VERTICES, false);
+        for (int svtx : get_string(vtx)) {
+            for (int avtx : get_neighbors(svtx)) {
+                if (m_state[avtx] == Board::EMPTY && !marked[avtx]) {
+                    marked[avtx] = true;
+                    ++liberties;
+                }
+            }
+        }
+        return liberties;
+    }
+
+    int compute_reach_color(int color) const {
+        return std::count(std::begin(m_state), std::end(m_state), color);
+    }
+
+    int get_state(int vtx) const {
+        return m_state[vtx];
+    }
+
+private:
+    std::vector<int> get_neighbors(int vtx) const {
+        const int x_shift = m_board_size + 2;
+        return {vtx - x_shift, vtx - 1, vtx + 1, vtx + x_shift};
+    }
+
+    std::vector<int> get_string(int vtx) const {
+        const int color = m_state[vtx];
+        std::vector<int> string{vtx};
+        std::vector<bool> marked(Board::NUM_VERTICES, false);
+        marked[vtx] = true;
+
+        for (size_t i = 0; i < string.size(); ++i) {
+            for (int avtx : get_neighbors(string[i])) {
+                if (m_state[avtx] == color && !marked[avtx]) {
+                    marked[avtx] = true;
+                    string.emplace_back(avtx);
+                }
+            }
+        }
+        return string;
+    }
+
+    int m_board_size;
+    int m_state[Board::NUM_VERTICES];
+};
+
+// The hash of the reference board is a function of the board state, so
+// the alternative backend recomputes it from its own state.
+template<typename Backend>
+static std::uint64_t compute_hash(const Backend &backend) {
+    char state_map[4] = {'x','o','.', '-'};
+    std::string str;
+    str.resize(Board::NUM_VERTICES, state_map[Board::INVLD]);
+
+    for (int vtx = 0; vtx < Board::NUM_VERTICES; ++vtx) {
+        str[vtx] = state_map[backend.get_state(vtx)];
+    }
+    return fnv1a_hash(str);
+}
+
+template<typename Backend>
+static std::string compare_boards(const Board &ref, const Backend &alt) {
+    std::ostringstream out;
+    const int board_size = ref.get_board_size();
+
+    if (ref.compute_hash() != compute_hash(alt)) {
+        out << "hash ";
+    }
+    for (int color = Board::BLACK; color <= Board::WHITE; ++color) {
+        if (ref.compute_reach_color(color) != alt.compute_reach_color(color)) {
+            out << "final_score ";
+            break;
+        }
+    }
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            const int vtx = ref.get_vertex(x, y);
+            const int state = ref.get_state(vtx);
+            if (state == Board::BLACK || state == Board::WHITE) {
+                if (ref.get_liberties(vtx) != alt.get_liberties(vtx)) {
+                    out << "liberties(" << x << "," << y << ") ";
+                }
+            }
+            for (int color = Board::BLACK; color <= Board::WHITE; ++color) {
+                if (ref.legal_move(vtx, color) != alt.legal_move(vtx, color)) {
+                    out << "legal_move(" << x << "," << y << "," << color << ") ";
+                }
+            }
+        }
+    }
+    return out.str();
+}
+
+// Replay the moves on both backends. Return the index of the first
+// mismatched move, -1 if all match, or -2 if a move is illegal on the
+// reference board.
+template<typename Backend>
+static int replay(const std::vector<int> &moves, std::string &error) {
+    Board ref;
+    Backend alt;
+    ref.reset_board(Board::BOARD_SIZE);
+    alt.reset_board(Board::BOARD_SIZE);
+    ref.set_to_move(Board::BLACK);
+
+    error = compare_boards(ref, alt);
+    if (!error.empty()) {
+        return 0;
+    }
+
+    int color = Board::BLACK;
+    for (size_t i = 0; i < moves.size(); ++i) {
+        if (!ref.legal_move(moves[i], color)) {
+            return -2;
+        }
+        ref.play_move_assume_legal(moves[i], color);
+        alt.play_move_assume_legal(moves[i], color);
+        color = !color;
+
+        error = compare_boards(ref, alt);
+        if (!error.empty()) {
+            return i+1;
+        }
+    }
+    return -1;
+}
+
+// Remove the moves while the mismatch remains. Removing two moves keeps
+// the colors of the later moves, so try it before removing one move.
+template<typename Backend>
+static std::vector<int> shrink(std::vector<int> moves) {
+    std::string error;
+    bool progress = true;
+
+    while (progress) {
+        progress = false;
+        for (int length = 2; length >= 1; --length) {
+            for (int i = (int)moves.size() - length; i >= 0; --i) {
+                if (i + length > (int)moves.size()) {
+                    continue;
+                }
+                auto candidate = moves;
+                candidate.erase(std::begin(candidate) + i,
+                                    std::begin(candidate) + i + length);
+                const int failed = replay<Backend>(candidate, error);
+                if (failed >= 0) {
+                    candidate.resize(failed);
+                    moves = candidate;
+                    progress = true;
+                }
+            }
+        }
+    }
+    return moves;
+}
+
+static std::string vertex_to_text(const Board &board, int vtx) {
+    const char *x_lable_map = "ABCDEFGHJKLMNOPQRST";
+    std::string out;
+    out += x_lable_map[board.get_x(vtx)];
+    out += std::to_string(board.get_y(vtx)+1);
+    return out;
+}
+
+template<typename Backend>
+static bool difftest_games(int games) {
+    std::atomic<int> next_game{0};
+    std::atomic<bool> failed{false};
+    std::mutex io_mutex;
+
+    auto worker = [&]() {
+        auto &rng = PRNG::get();
+        std::string error;
+
+        while (!failed.load() && next_game.fetch_add(1) < games) {
+            Board ref;
+            ref.reset_board(Board::BOARD_SIZE);
+
+            std::vector<int> moves;
+            std::vector<int> legal_moves;
+            int color = Board::BLACK;
+            while (true) {
+                legal_moves.clear();
+                for (int vtx = 0; vtx < Board::NUM_VERTICES; ++vtx) {
+                    if (ref.get_state(vtx) == Board::EMPTY &&
+                            ref.legal_move(vtx, color)) {
+                        legal_moves.emplace_back(vtx);
+                    }
+                }
+                if (legal_moves.empty()) {
+                    break;
+                }
+                const int vtx = legal_moves[rng.randuint32(legal_moves.size())];
+                ref.play_move_assume_legal(vtx, color);
+                moves.emplace_back(vtx);
+                color = !color;
+            }
+
+            const int failed_move = replay<Backend>(moves, error);
+            if (failed_move >= 0) {
+                failed.store(true);
+                moves.resize(failed_move);
+                auto minimal = shrink<Backend>(moves);
+                replay<Backend>(minimal, error);
+
+                std::lock_guard<std::mutex> lock(io_mutex);
+                fprintf(cfg_search_file, "Mismatch: %s\n", error.c_str());
+                fprintf(cfg_search_file, "Minimal moves (%zu):", minimal.size());
+                for (int vtx : minimal) {
+                    fprintf(cfg_search_file, " %s", vertex_to_text(ref, vtx).c_str());
+                }
+                fprintf(cfg_search_file, "\n");
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < std::max(cfg_search_threads, 1); ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+    return !failed.load();
+}
+
+bool run_difftest(int games) {
+    bool success = difftest_games<FloodFillBoard>(games);
+    fprintf(cfg_search_file, "%s after %d game(s).\n",
+                success ? "All boards match" : "Found a mismatch", games);
+    return success;
+}
+
+// The genmove commands of every run of the determinism check.
+#define DETERMINISM_MOVES (6)
+
+bool run_determinism_check(int runs, const std::vector<std::string> &args) {
+    std::ostringstream commands;
+    for (int i = 0; i < DETERMINISM_MOVES; ++i) {
+        commands << "genmove " << (i % 2 == 0 ? 'b' : 'w') << "\\n";
+    }
+    commands << "quit\\n";
+
+    // The path of this binary. The /proc/self of the shell would be
+    // the shell itself.
+    char exe[4096];
+    const ssize_t exe_size = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (exe_size <= 0) {
+        fprintf(cfg_search_file, "Fail to find the engine.\n");
+        return false;
+    }
+    exe[exe_size] = '\0';
+
+    // Quote every option for the shell. A random seed can not repeat,
+    // so the seed is fixed if it is not given.
+    auto quote = [](std::string arg) {
+        std::string quoted = "'";
+        for (char c : arg) {
+            quoted += c == '\'' ? std::string{"'\\''"} : std::string(1, c);
+        }
+        return quoted + "'";
+    };
+    std::ostringstream command;
+    command << "printf '" << commands.str() << "' | " << quote(exe);
+    for (const auto &arg : args) {
+        command << " " << quote(arg);
+    }
+    command << " --deterministic";
+    if (cfg_seed == 0) {
+        command << " --seed 1";
+    }
+    command << " 2>/dev/null";
+
+    std::string first;
+    bool success = true;
+    for (int run = 0; run < runs; ++run) {
+        FILE *pipe = popen(command.str().c_str(), "r");
+        if (!pipe) {
+            fprintf(cfg_search_file, "Fail to run the engine.\n");
+            return false;
+        }
+        std::string output;
+        char buf[256];
+        while (fgets(buf, sizeof(buf), pipe)) {
+            output += buf;
+        }
+        if (pclose(pipe) != 0) {
+            fprintf(cfg_search_file, "The engine of run %d failed.\n", run + 1);
+            return false;
+        }
+
+        std::string moves;
+        std::istringstream ss{output};
+        std::string line;
+        while (std::getline(ss, line)) {
+            if (line.size() > 2) {
+                moves += " " + line.substr(2);
+            }
+        }
+        fprintf(cfg_search_file, "Run %d:%s\n", run + 1, moves.c_str());
+
+        if (run == 0) {
+            first = output;
+        } else if (output != first) {
+            success = false;
+        }
+    }
+    fprintf(cfg_search_file, "%s after %d run(s).\n",
+                success ? "All runs match" : "Found a mismatch", runs);
+    return success;
+}
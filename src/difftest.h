@@ -0,0 +1,18 @@
+#ifndef DIFFTEST_H_INCLUDE
+#define DIFFTEST_H_INCLUDE
+
+#include <string>
+#include <vector>
+
+// Play random games on the reference Board and an alternative backend
+// at the same time, and compare them after every move. A failed game
+// is shrunk to a minimal move list and printed. Return true if all
+// games match.
+bool run_difftest(int games);
+
+// Run the GTP engine with the given options and --deterministic as a
+// child process several times, let it play the same moves and compare
+// the responses. Return true if all runs match.
+bool run_determinism_check(int runs, const std::vector<std::string> &args);
+
+#endif
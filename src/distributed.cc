@@ -0,0 +1,378 @@
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "distributed.h"
+#include "time_manager.h"
+#include "config.h"
+
+// The workers run the same binary on the same machine, so the board is
+// sent as raw bytes.
+static_assert(std::is_trivially_copyable<Board>::value,
+                  "The board must be trivially copyable.");
+
+enum MessageType : std::uint32_t {
+    MSG_POSITION = 1,
+    MSG_STATS = 2,
+
+    // The master is done. The worker stops the search and sends the
+    // statistics at once.
+    MSG_STOP = 3
+};
+
+struct MessageHeader {
+    std::uint32_t type;
+    std::uint32_t search_id;
+    std::uint32_t size;
+};
+
+struct PositionMessage {
+    std::int32_t max_playouts;
+    std::int32_t thinking_centis;
+    float komi;
+    Board board;
+};
+
+// One root child is packed as int16 vertex, int32 visits and int32
+// black wins.
+static constexpr int STAT_ENTRY_SIZE = 10;
+
+struct SocketAddress {
+    bool is_unix;
+    std::string path;
+    int port;
+};
+
+static SocketAddress parse_address(std::string address) {
+    SocketAddress addr{false, std::string{}, 0};
+
+    if (address.compare(0, 5, "unix:") == 0) {
+        addr.is_unix = true;
+        addr.path = address.substr(5);
+    } else if (address.find('/') != std::string::npos) {
+        addr.is_unix = true;
+        addr.path = address;
+    } else {
+        if (address.compare(0, 4, "tcp:") == 0) {
+            address = address.substr(4);
+        }
+        addr.port = std::stoi(address);
+    }
+    return addr;
+}
+
+static int open_socket(SocketAddress &addr, bool listen_mode) {
+    int fd = -1;
+    int ret = -1;
+
+    if (addr.is_unix) {
+        sockaddr_un sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        std::strncpy(sa.sun_path, addr.path.c_str(), sizeof(sa.sun_path)-1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (listen_mode) {
+            unlink(addr.path.c_str());
+            ret = bind(fd, (sockaddr *)&sa, sizeof(sa));
+        } else {
+            ret = connect(fd, (sockaddr *)&sa, sizeof(sa));
+        }
+    } else {
+        // Only the loopback is accepted.
+        sockaddr_in sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(addr.port);
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (listen_mode) {
+            int reuse = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            ret = bind(fd, (sockaddr *)&sa, sizeof(sa));
+        } else {
+            ret = connect(fd, (sockaddr *)&sa, sizeof(sa));
+        }
+    }
+
+    if (ret == 0 && listen_mode) {
+        ret = listen(fd, 64);
+    }
+    if (ret != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const void *buf, size_t size) {
+    const char *ptr = static_cast<const char *>(buf);
+    while (size > 0) {
+        ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void *buf, size_t size) {
+    char *ptr = static_cast<char *>(buf);
+    while (size > 0) {
+        ssize_t n = recv(fd, ptr, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool send_message(int fd, std::uint32_t type, std::uint32_t search_id,
+                             const std::vector<char> &payload) {
+    MessageHeader header{type, search_id, (std::uint32_t)payload.size()};
+    return send_all(fd, &header, sizeof(header)) &&
+               send_all(fd, payload.data(), payload.size());
+}
+
+static bool recv_message(int fd, MessageHeader &header, std::vector<char> &payload) {
+    if (!recv_all(fd, &header, sizeof(header))) {
+        return false;
+    }
+    payload.resize(header.size);
+    return recv_all(fd, payload.data(), payload.size());
+}
+
+static std::vector<char> encode_stats(const std::vector<RootStat> &stats) {
+    std::vector<char> payload(stats.size() * STAT_ENTRY_SIZE);
+    char *ptr = payload.data();
+
+    for (const auto &stat : stats) {
+        std::int16_t vertex = stat.vertex;
+        std::int32_t visits = stat.visits;
+        std::int32_t black_wins = stat.black_wins;
+        std::memcpy(ptr, &vertex, 2);
+        std::memcpy(ptr+2, &visits, 4);
+        std::memcpy(ptr+6, &black_wins, 4);
+        ptr += STAT_ENTRY_SIZE;
+    }
+    return payload;
+}
+
+static std::vector<RootStat> decode_stats(const std::vector<char> &payload) {
+    std::vector<RootStat> stats;
+    const char *ptr = payload.data();
+    const int size = payload.size() / STAT_ENTRY_SIZE;
+
+    for (int i = 0; i < size; ++i) {
+        std::int16_t vertex;
+        std::int32_t visits;
+        std::int32_t black_wins;
+        std::memcpy(&vertex, ptr, 2);
+        std::memcpy(&visits, ptr+2, 4);
+        std::memcpy(&black_wins, ptr+6, 4);
+        stats.emplace_back(RootStat{vertex, visits, black_wins});
+        ptr += STAT_ENTRY_SIZE;
+    }
+    return stats;
+}
+
+DistributedMaster::DistributedMaster(std::string address) {
+    auto addr = parse_address(address);
+    m_listen_fd = open_socket(addr, true);
+
+    if (m_listen_fd < 0) {
+        fprintf(cfg_search_file, "Can not listen on %s.\n", address.c_str());
+        return;
+    }
+    if (addr.is_unix) {
+        m_unix_path = addr.path;
+    }
+
+    m_running.store(true);
+    m_accept_thread = std::thread([this]() { accept_loop(); });
+    fprintf(cfg_search_file, "The master is listening on %s.\n", address.c_str());
+}
+
+DistributedMaster::~DistributedMaster() {
+    m_running.store(false);
+
+    if (m_listen_fd >= 0) {
+        // Wake up the blocking accept().
+        shutdown(m_listen_fd, SHUT_RDWR);
+        close(m_listen_fd);
+    }
+    if (m_accept_thread.joinable()) {
+        m_accept_thread.join();
+    }
+    for (int fd : m_workers) {
+        close(fd);
+    }
+    if (!m_unix_path.empty()) {
+        unlink(m_unix_path.c_str());
+    }
+}
+
+void DistributedMaster::accept_loop() {
+    while (m_running.load()) {
+        int fd = accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_workers.emplace_back(fd);
+        fprintf(cfg_search_file, "A worker is connected.\n");
+    }
+}
+
+void DistributedMaster::drop_worker(int fd) {
+    close(fd);
+    m_workers.erase(std::remove(std::begin(m_workers), std::end(m_workers), fd),
+                        std::end(m_workers));
+    fprintf(cfg_search_file, "A worker is disconnected.\n");
+}
+
+int DistributedMaster::get_num_workers() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_workers.size();
+}
+
+void DistributedMaster::broadcast(GameState &state,
+                                      int max_playouts, int thinking_centis) {
+    PositionMessage msg;
+    msg.max_playouts = max_playouts;
+    msg.thinking_centis = thinking_centis;
+    msg.komi = state.get_komi();
+    msg.board = state.board;
+
+    std::vector<char> payload(sizeof(msg));
+    std::memcpy(payload.data(), &msg, sizeof(msg));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_search_id++;
+
+    auto workers = m_workers;
+    for (int fd : workers) {
+        if (!send_message(fd, MSG_POSITION, m_search_id, payload)) {
+            drop_worker(fd);
+        }
+    }
+}
+
+std::vector<RootStat> DistributedMaster::gather(int timeout_centis) {
+    std::vector<RootStat> out;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto workers = m_workers;
+    for (int fd : workers) {
+        if (!send_message(fd, MSG_STOP, m_search_id, std::vector<char>{})) {
+            drop_worker(fd);
+        }
+    }
+
+    Time start;
+    workers = m_workers;
+    for (int fd : workers) {
+        while (true) {
+            int elapsed = Time::timediff_centis(start, Time());
+            int remaining = timeout_centis - elapsed;
+
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, 10 * std::max(remaining, 0)) <= 0) {
+                // Too slow. The late result will be discarded by
+                // the search id.
+                break;
+            }
+
+            MessageHeader header;
+            std::vector<char> payload;
+            if (!recv_message(fd, header, payload)) {
+                drop_worker(fd);
+                break;
+            }
+            if (header.type == MSG_STATS && header.search_id == m_search_id) {
+                auto stats = decode_stats(payload);
+                out.insert(std::end(out), std::begin(stats), std::end(stats));
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+void distributed_worker_loop(std::string address) {
+    auto addr = parse_address(address);
+    int fd = open_socket(addr, false);
+
+    if (fd < 0) {
+        fprintf(cfg_search_file, "Can not connect to %s.\n", address.c_str());
+        return;
+    }
+    fprintf(cfg_search_file, "Connected to the master %s.\n", address.c_str());
+
+    GameState state;
+    state.clear_board(Board::BOARD_SIZE, 0.f);
+    Search search(state);
+
+    MessageHeader header;
+    std::vector<char> payload;
+    bool pending = false;
+    bool connected = true;
+
+    while (connected) {
+        if (!pending && !recv_message(fd, header, payload)) {
+            break;
+        }
+        pending = false;
+        if (header.type != MSG_POSITION ||
+                payload.size() != sizeof(PositionMessage)) {
+            continue;
+        }
+
+        PositionMessage msg;
+        std::memcpy(&msg, payload.data(), sizeof(msg));
+        state.clear_board(msg.board.get_board_size(), msg.komi);
+        state.board = msg.board;
+
+        const std::uint32_t search_id = header.search_id;
+        auto stats = search.subsearch(msg.max_playouts, msg.thinking_centis,
+            [&]() {
+                // Stop at any message of the master. The stop comes
+                // before the next position, but a position is kept
+                // for the next loop anyway.
+                pollfd pfd{fd, POLLIN, 0};
+                if (poll(&pfd, 1, 0) <= 0) {
+                    return false;
+                }
+                if (!recv_message(fd, header, payload)) {
+                    connected = false;
+                } else if (header.type == MSG_POSITION) {
+                    pending = true;
+                }
+                return true;
+            });
+        if (!connected ||
+                !send_message(fd, MSG_STATS, search_id, encode_stats(stats))) {
+            break;
+        }
+    }
+    close(fd);
+    fprintf(cfg_search_file, "The master is disconnected.\n");
+}
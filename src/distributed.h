@@ -0,0 +1,51 @@
+#ifndef DISTRIBUTED_H_INCLUDE
+#define DISTRIBUTED_H_INCLUDE
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "game_state.h"
+#include "search.h"
+
+// The address is a UNIX-domain socket path ("unix:/tmp/nogo.sock" or any
+// path containing '/') or a TCP port on the loopback ("tcp:5566" or
+// "5566").
+class DistributedMaster {
+public:
+    explicit DistributedMaster(std::string address);
+    ~DistributedMaster();
+
+    // Send the root position and the search budget to all workers.
+    void broadcast(GameState &state, int max_playouts, int thinking_centis);
+
+    // Stop the workers and collect the root statistics of the last
+    // broadcast position. Wait at most timeout_centis for slow workers.
+    std::vector<RootStat> gather(int timeout_centis=100);
+
+    int get_num_workers();
+
+private:
+    void accept_loop();
+    void drop_worker(int fd);
+
+    int m_listen_fd{-1};
+    std::string m_unix_path;
+
+    std::mutex m_mutex;
+    std::vector<int> m_workers;
+
+    std::uint32_t m_search_id{0};
+
+    std::atomic<bool> m_running{false};
+    std::thread m_accept_thread;
+};
+
+// Connect to the master and serve the subsearches until the master
+// closes the connection.
+void distributed_worker_loop(std::string address);
+
+#endif
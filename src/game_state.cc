@@ -1,11 +1,25 @@
 #include <random>
 #include <algorithm>
+#include <cmath>
 
 #include "game_state.h"
 #include "random.h"
+#include "config.h"
+
+// The early stopped rollouts check the margin every STATIC_EVAL_INTERVAL
+// moves.
+#define STATIC_EVAL_INTERVAL (4)
+
+// The logistic slope of the static value per margin point.
+#define STATIC_EVAL_SCALE (0.5)
 
 void GameState::clear_board(int board_size, float komi) {
-    board.reset_board(board_size);
+    clear_board(board_size, komi, cfg_hollow_pos);
+}
+
+void GameState::clear_board(int board_size, float komi,
+                                const std::vector<std::array<int, 2>> &hollow_pos) {
+    board.reset_board(board_size, hollow_pos);
 
     m_game_history.clear();
     m_game_history.emplace_back(std::make_shared<Board>(board));
@@ -70,16 +84,16 @@ int GameState::play_random_move(int color, bool use_fast) {
         return Board::RESIGN;
     }
 
-    std::shuffle(std::begin(legal_moves),
-        std::end(legal_moves), PRNG::get());
-
+    // Draw the moves without replacement until one is not an eye.
+    auto &rng = PRNG::get();
     int move;
-    int size = legal_moves.size();
-    for (int i = 0; i < size; ++i) {
+    for (int remaining = legal_moves.size(); remaining > 0; --remaining) {
+        const int i = rng.randuint32(remaining);
         move = legal_moves[i];
         if (!board.is_eyeshape(move, color)) {
             break;
         }
+        legal_moves[i] = legal_moves[remaining-1];
     }
 
     if (use_fast) {
@@ -90,11 +104,33 @@ int GameState::play_random_move(int color, bool use_fast) {
     return move;
 }
 
-int GameState::rollouts() {
+// The side to move takes the first of the points both sides can play.
+static int compute_margin(int color, int black_only, int white_only, int both) {
+    const int own = color == Board::BLACK ? black_only : white_only;
+    const int opp = color == Board::BLACK ? white_only : black_only;
+    return (own + (both + 1) / 2) - (opp + both / 2);
+}
+
+int GameState::rollouts(int stop_margin) {
     auto fork_state = *this;
     int color, move;
-    while (true) {
+    int next_check = 0;
+    for (int ply = 0; true; ++ply) {
         color = fork_state.get_tomove();
+
+        if (stop_margin > 0 && ply >= next_check) {
+            int black_only, white_only, both;
+            fork_state.board.compute_exclusive_moves(black_only, white_only, both);
+            const int margin = compute_margin(color, black_only, white_only, both);
+            if (margin >= stop_margin) {
+                return color == Board::BLACK;
+            } else if (margin <= -stop_margin) {
+                return color == Board::WHITE;
+            }
+            // The margin hardly moves while many points are open to
+            // both sides, so check less often in the opening.
+            next_check = ply + std::max(STATIC_EVAL_INTERVAL, both / 4);
+        }
         move = fork_state.play_random_move(color, true);
 
         if (move == Board::RESIGN) {
@@ -105,6 +141,56 @@ int GameState::rollouts() {
     return black_win;
 }
 
+int GameState::exclusive_margin(int color) const {
+    int black_only, white_only, both;
+    board.compute_exclusive_moves(black_only, white_only, both);
+    return compute_margin(color, black_only, white_only, both);
+}
+
+int GameState::static_eval() const {
+    const int color = get_tomove();
+    const int margin = exclusive_margin(color);
+
+    // The side to move wins with the positive margin.
+    const double win = 1.0 / (1.0 + std::exp(-STATIC_EVAL_SCALE * (margin - 0.5)));
+    const bool tomove_win = PRNG::get().randuint32(1 << 16) < win * (1 << 16);
+    return tomove_win == (color == Board::BLACK);
+}
+
+float GameState::get_move_prior(int vtx, int color) const {
+    if (board.is_eyeshape(vtx, color)) {
+        return 0.f;
+    }
+    float prior = 1.f;
+    if (board.legal_move(vtx, !color)) {
+        prior += 2.f;
+    }
+
+    const int board_size = get_board_size();
+    const int x = get_x(vtx);
+    const int y = get_y(vtx);
+    const int dx[4] = {1, -1, 0, 0};
+    const int dy[4] = {0, 0, 1, -1};
+    for (int k = 0; k < 4; ++k) {
+        const int xx = x + dx[k];
+        const int yy = y + dy[k];
+        if (xx >= 0 && yy >= 0 && xx < board_size && yy < board_size &&
+                get_state(get_vertex(xx, yy)) == !color) {
+            prior += 0.5f;
+        }
+    }
+    return prior;
+}
+
+int GameState::evaluate(int static_eval_mode, int stop_margin) {
+    if (static_eval_mode == STATIC_EVAL_VALUE) {
+        return static_eval();
+    } else if (static_eval_mode == STATIC_EVAL_STOP) {
+        return rollouts(stop_margin);
+    }
+    return rollouts();
+}
+
 bool GameState::legal_move(int vtx, int color) {
     return board.legal_move(vtx, color);
 }
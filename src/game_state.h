@@ -12,6 +12,10 @@ public:
     // Clear the board.
     void clear_board(int board_size, float komi);
 
+    // Clear the board with the given hollow points.
+    void clear_board(int board_size, float komi,
+                         const std::vector<std::array<int, 2>> &hollow_pos);
+
     // Reture all legal moves.
     std::vector<int> get_legal_moves(int color) const;
 
@@ -27,8 +31,28 @@ public:
     // Generate a random move and play it.
     int play_random_move(int color, bool use_fast=false);
 
-    //
-    int rollouts();
+    // Play the random moves until the game is over. Return 1 if black
+    // wins. If the stop_margin is positive, stop once the exclusive-move
+    // margin of the side to move reaches it.
+    int rollouts(int stop_margin=0);
+
+    // The moves the color can still play minus the moves of its
+    // opponent if the color is to move: its exclusive points and about
+    // the half of the points both sides can play. The side to move
+    // loses if the margin is not positive.
+    int exclusive_margin(int color) const;
+
+    // Draw the result from the exclusive-move margin without playing.
+    // Return 1 if black wins.
+    int static_eval() const;
+
+    // The cheap prior of the move without the network. The points the
+    // opponent could take too come first, then the points next to the
+    // opponent stones. The own eyes come last.
+    float get_move_prior(int vtx, int color) const;
+
+    // Evaluate the leaf by the mode, one of the STATIC_EVAL_ modes.
+    int evaluate(int static_eval_mode, int stop_margin);
 
     // Return true if the move is legal.
     bool legal_move(int vtx, int color);
@@ -1,5 +1,6 @@
 #include <memory>
 #include <sstream>
+#include <fstream>
 #include <iostream>
 #include <array>
 #include <vector>
@@ -12,8 +13,14 @@
 #include "board.h"
 #include "search.h"
 #include "config.h"
+#include "perft.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "sgf.h"
+#include "tree_cache.h"
 
-static int command_id;
+// Every session of the server runs the commands on its own thread.
+static thread_local int command_id;
 
 std::vector<std::string> GTP_COMMANDS_LIST = {
     // Part of GTP version 2 standard command
@@ -55,11 +62,32 @@ std::vector<std::string> GTP_COMMANDS_LIST = {
     // Part of GTP version 2 standard command
     "final_score",
 
+    // Part of GTP version 2 standard command
+    "time_settings",
+
+    // Part of GTP version 2 standard command
+    "time_left",
+
+    // KGS extension of time_settings
+    "kgs-time_settings",
+
+    // Count the legal move sequences, "perft <depth> [cache|clear]"
+    "perft",
+
+    // The search phase counters as JSON, "stats [clear]"
+    "stats",
+
+    // Load the first game of a SGF file, "loadsgf <file> [move_number]"
+    "loadsgf",
+
+    // Show the game as SGF or save it, "printsgf [file]"
+    "printsgf",
+
     // Special command for hollow nogo
     "hollow"
 };
 
-void gtp_prcoess(GameState *main_game, Search *search);
+void gtp_prcoess(GameState *main_game, Search *search, GtpSettings &settings);
 std::string gtp_success(std::string response);
 std::string gtp_fail(std::string response);
 void gtp_hint();
@@ -67,21 +95,38 @@ void gtp_hint();
 void gtp_loop() {
     auto main_game = std::make_unique<GameState>();
     auto search = std::make_unique<Search>(*main_game);
+    GtpSettings settings;
 
-    main_game->clear_board(9, 0.f);
-    search->time_setting(cfg_main_time);
+    main_game->clear_board(9, 0.f, settings.hollow_pos);
+    search->time_setting(settings.main_time, settings.byo_time,
+                             settings.byo_stones, settings.byo_periods);
 
     for (;;) {
-        gtp_prcoess(main_game.get(), search.get());
+        gtp_prcoess(main_game.get(), search.get(), settings);
     }
 }
 
-void gtp_prcoess(GameState *main_game, Search *search) {
+void gtp_prcoess(GameState *main_game, Search *search, GtpSettings &settings) {
     std::string inputs;
     if (!std::getline(std::cin, inputs)) {
         return;
     }
 
+    bool quit = false;
+    std::cout << gtp_execute(main_game, search, settings, inputs, quit);
+    if (quit) {
+        if (TreeCache::enabled()) {
+            TreeCache::get().save();
+        }
+        exit(EXIT_SUCCESS);
+    }
+}
+
+std::string gtp_execute(GameState *main_game, Search *search, GtpSettings &settings,
+                            std::string inputs, bool &quit) {
+    std::ostringstream out_stream;
+    quit = false;
+
     std::istringstream ss{inputs};
     std::string buf;
     std::vector<std::string> args;
@@ -91,7 +136,7 @@ void gtp_prcoess(GameState *main_game, Search *search) {
     }
 
     if (args.empty()) {
-        return;
+        return std::string{};
     }
 
     // check the command id here
@@ -111,48 +156,50 @@ void gtp_prcoess(GameState *main_game, Search *search) {
     const auto main_cmd = args[0];
 
     if (argc == 0) {
-        return;
+        return std::string{};
     }
 
     if (main_cmd == "quit") {
-        std::cout << gtp_success(std::string{});
-        exit(EXIT_SUCCESS);
+        out_stream << gtp_success(std::string{});
+        quit = true;
     } else if (main_cmd == "protocol_version") {
-        std::cout << gtp_success("2");
+        out_stream << gtp_success("2");
     } else if (main_cmd == "name") {
-        std::cout << gtp_success("Go Bot");
+        out_stream << gtp_success("Go Bot");
     } else if (main_cmd == "version") {
-        std::cout << gtp_success("0.1");
+        out_stream << gtp_success("0.1");
     } else if (main_cmd == "boardsize") {
         if (argc >= 2) {
             int bsize = std::stoi(args[1]);
             float komi = main_game->get_komi();
-            main_game->clear_board(bsize, komi);
-            search->time_setting(cfg_main_time);
+            main_game->clear_board(bsize, komi, settings.hollow_pos);
+            search->time_setting(settings.main_time, settings.byo_time,
+                                     settings.byo_stones, settings.byo_periods);
 
-            std::cout << gtp_success(std::string{});
+            out_stream << gtp_success(std::string{});
         } else {
-            std::cout << gtp_fail(std::string{});
+            out_stream << gtp_fail(std::string{});
         }
     } else if (main_cmd == "komi") {
         if (argc >= 2) {
             float komi = std::stof(args[1]);
             main_game->set_komi(komi);
 
-            std::cout << gtp_success(std::string{});
+            out_stream << gtp_success(std::string{});
         } else {
-            std::cout << gtp_fail(std::string{});
+            out_stream << gtp_fail(std::string{});
         }
     } else if (main_cmd == "clear_board") {
         int bsize = main_game->get_board_size();
         float komi = main_game->get_komi();
-        main_game->clear_board(bsize, komi);
-        search->time_setting(cfg_main_time);
+        main_game->clear_board(bsize, komi, settings.hollow_pos);
+        search->time_setting(settings.main_time, settings.byo_time,
+                                 settings.byo_stones, settings.byo_periods);
 
-        std::cout << gtp_success(std::string{});
+        out_stream << gtp_success(std::string{});
     }  else if (main_cmd == "undo") {
         main_game->undo_move();
-        std::cout << gtp_success(std::string{});
+        out_stream << gtp_success(std::string{});
     } else if (main_cmd == "play") {
         int color = Board::INVLD;
         int vtx = Board::NULL_VERTEX;
@@ -193,9 +240,9 @@ void gtp_prcoess(GameState *main_game, Search *search) {
         if (color != Board::INVLD &&
                 vtx != Board::NULL_VERTEX &&
                 main_game->play_move(vtx, color)) {
-            std::cout << gtp_success(std::string{});
+            out_stream << gtp_success(std::string{});
         } else {
-            std::cout << gtp_fail(std::string{});
+            out_stream << gtp_fail(std::string{});
         }
     } else if (main_cmd == "genmove") {
         // TODO: You should implement your move generator here.
@@ -213,6 +260,9 @@ void gtp_prcoess(GameState *main_game, Search *search) {
         main_game->set_to_move(color);
         int vtx = search->think();
         main_game->play_move(vtx, color);
+        if (Tracer::enabled()) {
+            Tracer::get().dump();
+        }
 
         std::string out;
 
@@ -230,10 +280,10 @@ void gtp_prcoess(GameState *main_game, Search *search) {
             out += std::to_string(y+1);
         }
 
-        std::cout << gtp_success(out);
+        out_stream << gtp_success(out);
     } else if (main_cmd == "showboard") {
         main_game->showboard();
-        std::cout << gtp_success(std::string{});
+        out_stream << gtp_success(std::string{});
     } else if (main_cmd == "final_score") {
         float score = main_game->final_score();
         std::ostringstream result;
@@ -245,7 +295,133 @@ void gtp_prcoess(GameState *main_game, Search *search) {
         } else if (score < 0.f) {
             result << "w+" << -score;
         }
-        std::cout << gtp_success(result.str());
+        out_stream << gtp_success(result.str());
+    } else if (main_cmd == "time_settings") {
+        if (argc >= 4) {
+            int main_time = std::stoi(args[1]);
+            int byo_time = std::stoi(args[2]);
+            int byo_stones = std::stoi(args[3]);
+
+            if (byo_time > 0 && byo_stones == 0) {
+                // No time limits.
+                main_time = 7 * 24 * 60 * 60;
+                byo_time = 0;
+            }
+            settings.main_time = main_time;
+            settings.byo_time = byo_time;
+            settings.byo_stones = byo_stones;
+            settings.byo_periods = 0;
+            search->time_setting(settings.main_time, settings.byo_time,
+                                     settings.byo_stones, settings.byo_periods);
+            out_stream << gtp_success(std::string{});
+        } else {
+            out_stream << gtp_fail("syntax not understood");
+        }
+    } else if (main_cmd == "kgs-time_settings") {
+        bool success = true;
+        std::string type = argc >= 2 ? args[1] : std::string{};
+
+        settings.byo_time = 0;
+        settings.byo_stones = 0;
+        settings.byo_periods = 0;
+        if (type == "none") {
+            settings.main_time = 7 * 24 * 60 * 60;
+        } else if (type == "absolute" && argc >= 3) {
+            settings.main_time = std::stoi(args[2]);
+        } else if (type == "byoyomi" && argc >= 5) {
+            settings.main_time = std::stoi(args[2]);
+            settings.byo_time = std::stoi(args[3]);
+            settings.byo_periods = std::stoi(args[4]);
+        } else if (type == "canadian" && argc >= 5) {
+            settings.main_time = std::stoi(args[2]);
+            settings.byo_time = std::stoi(args[3]);
+            settings.byo_stones = std::stoi(args[4]);
+        } else {
+            success = false;
+        }
+
+        if (success) {
+            search->time_setting(settings.main_time, settings.byo_time,
+                                     settings.byo_stones, settings.byo_periods);
+            out_stream << gtp_success(std::string{});
+        } else {
+            out_stream << gtp_fail("syntax not understood");
+        }
+    } else if (main_cmd == "time_left") {
+        int color = Board::INVLD;
+        if (argc >= 4) {
+            if (std::tolower(args[1][0]) == 'b') {
+                color = Board::BLACK;
+            } else if (std::tolower(args[1][0]) == 'w') {
+                color = Board::WHITE;
+            }
+        }
+        if (color != Board::INVLD) {
+            search->time_left(color, std::stoi(args[2]), std::stoi(args[3]));
+            out_stream << gtp_success(std::string{});
+        } else {
+            out_stream << gtp_fail("syntax not understood");
+        }
+    } else if (main_cmd == "perft") {
+        if (argc >= 2) {
+            int depth = std::stoi(args[1]);
+            bool use_cache = false;
+            if (argc >= 3 && args[2] == "cache") {
+                use_cache = true;
+            } else if (argc >= 3 && args[2] == "clear") {
+                clear_perft_cache();
+            }
+
+            auto result = perft(*main_game, depth, cfg_search_threads, use_cache);
+            std::ostringstream out;
+            out << "nodes " << result.nodes
+                    << ", time " << result.seconds << " sec"
+                    << ", nps " << (std::uint64_t)(result.nodes / std::max(result.seconds, 1e-6));
+            out_stream << gtp_success(out.str());
+        } else {
+            out_stream << gtp_fail("syntax not understood");
+        }
+    } else if (main_cmd == "loadsgf") {
+        SgfGame game;
+        if (argc < 2) {
+            out_stream << gtp_fail("syntax not understood");
+        } else if (!SgfReader(args[1]).next_game(game)) {
+            out_stream << gtp_fail("cannot load file");
+        } else {
+            // The position before the move number.
+            int max_moves = -1;
+            if (argc >= 3) {
+                max_moves = std::max(std::stoi(args[2]) - 1, 0);
+            }
+            if (sgf_to_game_state(game, *main_game, max_moves)) {
+                // A new game, like clear_board.
+                search->time_setting(settings.main_time, settings.byo_time,
+                                         settings.byo_stones, settings.byo_periods);
+                out_stream << gtp_success(std::string{});
+            } else {
+                out_stream << gtp_fail("illegal move in file");
+            }
+        }
+    } else if (main_cmd == "printsgf") {
+        auto sgf = game_state_to_sgf(*main_game);
+        if (argc >= 2) {
+            std::ofstream file{args[1]};
+            if (file.is_open()) {
+                file << sgf << std::endl;
+                out_stream << gtp_success(std::string{});
+            } else {
+                out_stream << gtp_fail("cannot save file");
+            }
+        } else {
+            out_stream << gtp_success(sgf);
+        }
+    } else if (main_cmd == "stats") {
+        if (argc >= 2 && args[1] == "clear") {
+            Profiler::get().clear();
+            out_stream << gtp_success(std::string{});
+        } else {
+            out_stream << gtp_success(Profiler::get().get_json());
+        }
     } else if (main_cmd == "hollow") {
         int bsize = main_game->get_board_size();
         auto hollow_pos_buf = std::vector<std::array<int, 2>>{};
@@ -265,12 +441,13 @@ void gtp_prcoess(GameState *main_game, Search *search) {
             hollow_pos_buf.emplace_back(std::array<int, 2>{x,y});
         }
         if (hollow_pos_buf.size() == argc - 1) {
-           cfg_hollow_pos = hollow_pos_buf;
-           main_game->clear_board(bsize, main_game->get_komi());
-           search->time_setting(cfg_main_time);
-           std::cout << gtp_success(std::string{});
+           settings.hollow_pos = hollow_pos_buf;
+           main_game->clear_board(bsize, main_game->get_komi(), settings.hollow_pos);
+           search->time_setting(settings.main_time, settings.byo_time,
+                                    settings.byo_stones, settings.byo_periods);
+           out_stream << gtp_success(std::string{});
         } else {
-           std::cout << gtp_fail("vertex is not accepted");
+           out_stream << gtp_fail("vertex is not accepted");
         }
     } else if (main_cmd == "help" ||
                    main_cmd == "list_commands") {
@@ -283,10 +460,11 @@ void gtp_prcoess(GameState *main_game, Search *search) {
             list_commands << cmd;
             if (++idx != GTP_COMMANDS_LIST.size()) list_commands << std::endl;
         }
-        std::cout << gtp_success(list_commands.str());
+        out_stream << gtp_success(list_commands.str());
     } else {
-        std::cout << gtp_fail("unknown command");
+        out_stream << gtp_fail("unknown command");
     }
+    return out_stream.str();
 }
 
 std::string gtp_success(std::string response) {
@@ -1,6 +1,31 @@
 #ifndef GTP_H_INCLUDE
 #define GTP_H_INCLUDE
 
+#include <array>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+class GameState;
+class Search;
+
+// The settings of one GTP game. They start from the cfg_ values and
+// the commands only change them here, so that the sessions of the
+// server never share them.
+struct GtpSettings {
+    std::vector<std::array<int, 2>> hollow_pos{cfg_hollow_pos};
+    int main_time{cfg_main_time};
+    int byo_time{cfg_byo_time};
+    int byo_stones{cfg_byo_stones};
+    int byo_periods{cfg_byo_periods};
+};
+
 void gtp_loop();
 
+// Execute one line of GTP command and return the response. The quit is
+// set by the quit command.
+std::string gtp_execute(GameState *main_game, Search *search, GtpSettings &settings,
+                            std::string inputs, bool &quit);
+
 #endif
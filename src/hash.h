@@ -0,0 +1,18 @@
+#ifndef HASH_H_INCLUDE
+#define HASH_H_INCLUDE
+
+#include <cstdint>
+#include <string>
+
+// The 64-bit FNV-1a hash. Unlike std::hash, it is the same for every
+// build, so the keys written to the files stay valid.
+inline std::uint64_t fnv1a_hash(const std::string &str) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#endif
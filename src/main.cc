@@ -2,7 +2,19 @@
 #include <iostream>
 
 #include "gtp.h"
+#include "distributed.h"
+#include "bench.h"
+#include "difftest.h"
+#include "match.h"
+#include "server.h"
+#include "analyze.h"
+#include "tree_cache.h"
+#include "book.h"
+#include "network.h"
+#include "training.h"
 #include "config.h"
+#include "random.h"
+#include "affinity.h"
 
 void parse_args_and_loop(int argc, char ** argv) {
     for (int i = 1; i < argc; ++i) {
@@ -14,10 +26,56 @@ void parse_args_and_loop(int argc, char ** argv) {
                 << "             -t, --threads <int>: number of search threads\n"
                 << "            -p, --playouts <int>: number of playouts per move\n"
                 << "--node-expanding-threshold <int>: expanding visits threshold\n"
+                << "           --root-parallel <int>: number of independent search trees\n"
+                << "              --root-share <int>: share the upper tree statistics every n playouts\n"
+                << "            --virtual-loss <int>: the virtual loss per running playout\n"
+                << "      --virtual-loss-mode <mode>: fixed, adaptive or wu-uct virtual loss\n"
+                << "   --affinity <none|core|socket>: pin the search threads to cores or sockets\n"
+                << "                    --numa-arena: allocate the nodes from per NUMA node arenas\n"
                 << "                --main-time<int>: the thinking time of a game\n"
+                << "                --byo-time <int>: the byo-yomi time of a period\n"
+                << "              --byo-stones <int>: the stones per period of the Canadian byo-yomi\n"
+                << "             --byo-periods <int>: the periods of the Japanese byo-yomi\n"
+                << "              --lag-buffer <int>: the initial lag buffer in seconds\n"
+                << "              --master <address>: accept the workers on a local socket\n"
+                << "              --worker <address>: run as a worker of the master\n"
                 << "                      --analysis: show MCTS search status\n"
+                << "                         --bench: measure the throughput and print the JSON report\n"
+                << "              --difftest <games>: compare the board backends on random games\n"
+                << "      --determinism-check <runs>: run the deterministic genmoves again and compare them\n"
+                << "                --profile-timers: time the search phases for the stats command\n"
+                << "                --trace <prefix>: dump the Chrome trace after each genmove\n"
+                << "                    --seed <int>: the seed of the random streams, 0 is random\n"
+                << "                 --deterministic: one thread and no time limit, reproducible with --seed\n"
+                << "                 --match <games>: play a match between the side A and B\n"
+                << "          --match-parallel <int>: number of concurrent match games\n"
+                << "             --side-a <settings>: like threads=1,playouts=1600,time=60,c_uct=1,fpu=5\n"
+                << "             --side-b <settings>: the settings of the side B\n"
+                << "            --sprt <elo0> <elo1>: the SPRT bounds of the match\n"
+                << "                        --server: serve many sessions over the multiplexed GTP\n"
+                << "                --analyze <file>: analyze the positions of the file\n"
+                << "         --analyze-output <file>: append the JSON lines to the file and resume it\n"
+                << "         --analyze-workers <int>: number of positions searched at once\n"
+                << "             --tree-cache <file>: keep the top of the search trees in the file\n"
+                << "                   --book <file>: answer the covered openings from the book\n"
+                << "             --book-build <file>: search the openings of the layout and write the book\n"
+                << "              --book-depth <int>: the plies of the built book\n"
+                << " --static-eval <none|stop|value>: stop the rollouts by the exclusive moves or skip them\n"
+                << "           --static-margin <int>: the decisive exclusive-move margin\n"
+                << "                --weights <file>: evaluate the leaves by the network with PUCT\n"
+                << "     --nn-precision <int8|float>: the precision of the network convolutions\n"
+                << "                --nn-batch <int>: the network batch size, 0 is the search threads\n"
+                << "              --selfplay <games>: play the games and write the training data\n"
+                << "        --selfplay-output <file>: append the training data to the file\n"
+                << "             --selfplay-compress: compress the training data chunks, needs -DUSE_ZLIB\n"
+                << "          --training-dump <file>: print the training records as JSON lines\n"
+                << "                       --augment: dump the records under every symmetry of the layout\n"
+                << "                --widening <int>: widen the children progressively from the first n, 0 is off\n"
+                << "     --root-policy <uct|halving>: the UCT or the Gumbel sequential halving root\n"
+                << "      --halving-candidates <int>: the sampled root moves of the halving\n"
                 << "                     --no-hollow: remove the hollow positions\n"
-                << "                     --no-resign: disable the resign move when low win-rate\n";
+                << "                     --no-resign: disable the resign move when low win-rate\n"
+                << "              --no-adaptive-time: always use the whole thinking time\n";
             exit(0);
         }
 
@@ -27,17 +85,195 @@ void parse_args_and_loop(int argc, char ** argv) {
             cfg_playouts = std::stoi(argv[++i]);
         } else if (val == "--node-expanding-threshold") {
             cfg_node_expanding_thres = std::stoi(argv[++i]);
+        } else if (val == "--root-parallel") {
+            cfg_root_parallel_trees = std::stoi(argv[++i]);
+        } else if (val == "--root-share") {
+            cfg_root_share_interval = std::stoi(argv[++i]);
         } else if (val == "--main-time") {
             cfg_main_time = std::stoi(argv[++i]);
+        } else if (val == "--virtual-loss") {
+            cfg_virtual_loss = std::stoi(argv[++i]);
+        } else if (val == "--virtual-loss-mode") {
+            std::string mode(argv[++i]);
+            if (mode == "adaptive") {
+                cfg_virtual_loss_mode = VIRTUAL_LOSS_ADAPTIVE;
+            } else if (mode == "wu-uct") {
+                cfg_virtual_loss_mode = VIRTUAL_LOSS_WU_UCT;
+            } else {
+                cfg_virtual_loss_mode = VIRTUAL_LOSS_FIXED;
+            }
+        } else if (val == "--affinity") {
+            std::string mode(argv[++i]);
+            if (mode == "core") {
+                cfg_thread_affinity = Affinity::CORE;
+            } else if (mode == "socket") {
+                cfg_thread_affinity = Affinity::SOCKET;
+            } else {
+                cfg_thread_affinity = Affinity::NONE;
+            }
+        } else if (val == "--numa-arena") {
+            cfg_numa_arena = true;
+        } else if (val == "--master") {
+            cfg_master_address = argv[++i];
+        } else if (val == "--worker") {
+            cfg_worker_address = argv[++i];
+        } else if (val == "--byo-time") {
+            cfg_byo_time = std::stoi(argv[++i]);
+        } else if (val == "--byo-stones") {
+            cfg_byo_stones = std::stoi(argv[++i]);
+        } else if (val == "--byo-periods") {
+            cfg_byo_periods = std::stoi(argv[++i]);
+        } else if (val == "--lag-buffer") {
+            cfg_lag_buffer = std::stoi(argv[++i]);
+        } else if (val == "--bench") {
+            cfg_bench = true;
+        } else if (val == "--difftest") {
+            cfg_difftest_games = std::stoi(argv[++i]);
+        } else if (val == "--determinism-check") {
+            cfg_determinism_runs = std::stoi(argv[++i]);
+        } else if (val == "--profile-timers") {
+            cfg_profile_timers = true;
+        } else if (val == "--trace") {
+            cfg_trace_file = argv[++i];
+        } else if (val == "--seed") {
+            cfg_seed = std::stoull(argv[++i]);
+        } else if (val == "--deterministic") {
+            cfg_deterministic = true;
+        } else if (val == "--match") {
+            cfg_match_games = std::stoi(argv[++i]);
+        } else if (val == "--match-parallel") {
+            cfg_match_parallel = std::stoi(argv[++i]);
+        } else if (val == "--side-a") {
+            cfg_match_settings[0] = argv[++i];
+        } else if (val == "--side-b") {
+            cfg_match_settings[1] = argv[++i];
+        } else if (val == "--sprt") {
+            cfg_sprt_elo0 = std::stof(argv[++i]);
+            cfg_sprt_elo1 = std::stof(argv[++i]);
+        } else if (val == "--server") {
+            cfg_server = true;
+        } else if (val == "--analyze") {
+            cfg_analyze_input = argv[++i];
+        } else if (val == "--analyze-output") {
+            cfg_analyze_output = argv[++i];
+        } else if (val == "--analyze-workers") {
+            cfg_analyze_workers = std::stoi(argv[++i]);
+        } else if (val == "--tree-cache") {
+            cfg_tree_cache_file = argv[++i];
+        } else if (val == "--book") {
+            cfg_book_file = argv[++i];
+        } else if (val == "--book-build") {
+            cfg_book_build_file = argv[++i];
+        } else if (val == "--book-depth") {
+            cfg_book_depth = std::stoi(argv[++i]);
+        } else if (val == "--static-eval") {
+            std::string mode(argv[++i]);
+            if (mode == "stop") {
+                cfg_static_eval = STATIC_EVAL_STOP;
+            } else if (mode == "value") {
+                cfg_static_eval = STATIC_EVAL_VALUE;
+            } else {
+                cfg_static_eval = STATIC_EVAL_NONE;
+            }
+        } else if (val == "--static-margin") {
+            cfg_static_margin = std::stoi(argv[++i]);
+        } else if (val == "--weights") {
+            cfg_nn_weights_file = argv[++i];
+        } else if (val == "--nn-precision") {
+            cfg_nn_int8 = std::string(argv[++i]) != "float";
+        } else if (val == "--nn-batch") {
+            cfg_nn_batch_size = std::stoi(argv[++i]);
+        } else if (val == "--selfplay") {
+            cfg_selfplay_games = std::stoi(argv[++i]);
+        } else if (val == "--selfplay-output") {
+            cfg_selfplay_output = argv[++i];
+        } else if (val == "--selfplay-compress") {
+            cfg_selfplay_compress = true;
+        } else if (val == "--training-dump") {
+            cfg_training_dump = argv[++i];
+        } else if (val == "--augment") {
+            cfg_training_augment = true;
+        } else if (val == "--widening") {
+            cfg_widening_base = std::stoi(argv[++i]);
+        } else if (val == "--root-policy") {
+            std::string mode(argv[++i]);
+            cfg_root_policy = mode == "halving" ? ROOT_POLICY_HALVING : ROOT_POLICY_UCT;
+        } else if (val == "--halving-candidates") {
+            cfg_halving_candidates = std::stoi(argv[++i]);
         } else if (val == "--analysis") {
             cfg_dump_analysis = true;
         } else if (val == "--no-hollow") {
             cfg_hollow_pos.clear();
         } else if (val == "--no-resign") {
             cfg_enable_resign = false;
+        } else if (val == "--no-adaptive-time") {
+            cfg_adaptive_time = false;
         }
     }
-    gtp_loop();
+
+    PRNG::set_seed(cfg_seed);
+    if (cfg_deterministic) {
+        // The playouts are the only budget and one thread runs them in
+        // a fixed order.
+        cfg_search_threads = 1;
+        cfg_root_parallel_trees = 1;
+        cfg_adaptive_time = false;
+    }
+
+    if (TreeCache::enabled()) {
+        TreeCache::get().load(cfg_tree_cache_file);
+    }
+
+    if (Network::enabled()) {
+        Network::get().load(cfg_nn_weights_file, cfg_nn_int8);
+    }
+
+    if (Book::enabled()) {
+        Book::get().load(cfg_book_file);
+    }
+
+    if (cfg_bench) {
+        run_bench();
+    } else if (cfg_match_games > 0) {
+        run_match(cfg_match_games);
+    } else if (cfg_difftest_games > 0) {
+        if (!run_difftest(cfg_difftest_games)) {
+            exit(1);
+        }
+    } else if (cfg_determinism_runs > 0) {
+        // The runs take the other options.
+        std::vector<std::string> args;
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]) == "--determinism-check") {
+                ++i;
+            } else {
+                args.emplace_back(argv[i]);
+            }
+        }
+        if (!run_determinism_check(cfg_determinism_runs, args)) {
+            exit(1);
+        }
+    } else if (cfg_selfplay_games > 0) {
+        run_selfplay(cfg_selfplay_games, cfg_selfplay_output);
+    } else if (!cfg_training_dump.empty()) {
+        run_training_dump(cfg_training_dump, cfg_training_augment);
+    } else if (!cfg_book_build_file.empty()) {
+        if (!build_book(cfg_book_build_file, cfg_book_depth)) {
+            exit(1);
+        }
+    } else if (!cfg_analyze_input.empty()) {
+        run_analyze(cfg_analyze_input, cfg_analyze_output);
+    } else if (cfg_server) {
+        server_loop();
+    } else if (!cfg_worker_address.empty()) {
+        distributed_worker_loop(cfg_worker_address);
+    } else {
+        gtp_loop();
+    }
+
+    if (TreeCache::enabled()) {
+        TreeCache::get().save();
+    }
 }
 
 int main(int argc, char ** argv) {
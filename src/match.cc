@@ -0,0 +1,267 @@
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "match.h"
+#include "game_state.h"
+#include "search.h"
+#include "random.h"
+#include "time_manager.h"
+#include "config.h"
+
+// The random moves at the start of every game.
+#define MATCH_OPENING_MOVES (4)
+
+// The random hollow points. Each one is mirrored through the center.
+#define MATCH_HOLLOW_PAIRS (4)
+
+// The error rates of the SPRT.
+#define SPRT_ALPHA (0.05)
+#define SPRT_BETA (0.05)
+
+// The stream of the match generator, apart from the search threads.
+#define MATCH_STREAM (1 << 15)
+
+struct Side {
+    SearchParameters parameters;
+    int main_time{cfg_main_time};
+
+    // The throughput of the side.
+    long long playouts{0};
+    double think_seconds{0};
+};
+
+struct MatchStats {
+    int games{0};
+    int a_wins{0};
+    int b_wins{0};
+    Side sides[2];
+};
+
+// Parse the settings like "threads=2,playouts=1600,time=60,c_uct=1.2,fpu=5".
+// The static=none|stop|value and margin=4 select the leaf evaluation,
+// and the root=uct|halving selects the root policy.
+static Side parse_side(std::string settings) {
+    Side side;
+    std::istringstream ss{settings};
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+        auto eq = item.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        auto key = item.substr(0, eq);
+        auto val = item.substr(eq+1);
+        if (key == "threads") {
+            side.parameters.threads = std::stoi(val);
+        } else if (key == "playouts") {
+            side.parameters.playouts = std::stoi(val);
+        } else if (key == "time") {
+            side.main_time = std::stoi(val);
+        } else if (key == "c_uct") {
+            side.parameters.c_uct = std::stof(val);
+        } else if (key == "fpu") {
+            side.parameters.fpu_value = std::stof(val);
+        } else if (key == "static") {
+            side.parameters.static_eval =
+                val == "stop" ? STATIC_EVAL_STOP :
+                val == "value" ? STATIC_EVAL_VALUE : STATIC_EVAL_NONE;
+        } else if (key == "margin") {
+            side.parameters.static_margin = std::stoi(val);
+        } else if (key == "root") {
+            side.parameters.root_policy =
+                val == "halving" ? ROOT_POLICY_HALVING : ROOT_POLICY_UCT;
+        } else {
+            fprintf(stderr, "Unknown match setting %s.\n", key.c_str());
+        }
+    }
+    return side;
+}
+
+static double elo_to_score(double elo) {
+    return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+// The log-likelihood ratio of elo1 against elo0 for the scores of A.
+static double compute_llr(int wins, int losses) {
+    const double p0 = elo_to_score(cfg_sprt_elo0);
+    const double p1 = elo_to_score(cfg_sprt_elo1);
+    return wins * std::log(p1 / p0) + losses * std::log((1 - p1) / (1 - p0));
+}
+
+static double compute_elo(int wins, int losses) {
+    const double score = (wins + 0.5) / (wins + losses + 1.0);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+// Build a random hollow layout and play the random opening moves.
+static void prepare_game(GameState &state, std::uint64_t seed) {
+    PRNG rng(seed);
+
+    const int board_size = Board::BOARD_SIZE;
+    std::vector<std::array<int, 2>> hollow_pos;
+    for (int i = 0; i < MATCH_HOLLOW_PAIRS; ++i) {
+        const int x = rng.randuint32(board_size);
+        const int y = rng.randuint32(board_size);
+        if (x == board_size / 2 && y == board_size / 2) {
+            continue;
+        }
+        hollow_pos.push_back({x, y});
+        hollow_pos.push_back({board_size-1-x, board_size-1-y});
+    }
+
+    state.clear_board(board_size, 0.f, hollow_pos);
+
+    for (int i = 0; i < MATCH_OPENING_MOVES; ++i) {
+        const int color = state.get_tomove();
+        auto legal_moves = state.get_legal_moves(color);
+        if (legal_moves.empty()) {
+            break;
+        }
+        state.play_move(legal_moves[rng.randuint32(legal_moves.size())], color);
+    }
+}
+
+// Play one game. Return the index of the winning side.
+static int play_game(Side sides[2], int black_side,
+                         std::uint64_t seed, int &moves) {
+    GameState state;
+    prepare_game(state, seed);
+
+    std::unique_ptr<Search> searches[2];
+    for (int s = 0; s < 2; ++s) {
+        searches[s] = std::make_unique<Search>(state, sides[s].parameters);
+        searches[s]->time_setting(sides[s].main_time);
+    }
+
+    moves = 0;
+    while (true) {
+        const int color = state.get_tomove();
+        const int s = (color == Board::BLACK) ? black_side : !black_side;
+
+        Time start;
+        const int vtx = searches[s]->think();
+        sides[s].think_seconds += Time::timediff_seconds(start, Time());
+        sides[s].playouts += searches[s]->get_playouts();
+
+        if (vtx == Board::RESIGN || !state.play_move(vtx, color)) {
+            return !s;
+        }
+        ++moves;
+    }
+}
+
+void run_match(int games) {
+    Side sides[2] = {parse_side(cfg_match_settings[0]),
+                         parse_side(cfg_match_settings[1])};
+
+    // Keep the search logs of the games quiet.
+    FILE *null_file = fopen("/dev/null", "w");
+    FILE *search_file = cfg_search_file;
+    if (null_file && !cfg_dump_analysis) {
+        cfg_search_file = null_file;
+    }
+
+    // The paired games share the seed.
+    PRNG rng(PRNG::get_stream_seed(MATCH_STREAM));
+    std::vector<std::uint64_t> seeds((games + 1) / 2);
+    for (auto &seed : seeds) {
+        seed = rng.rand64() | 1;
+    }
+
+    const double lower_bound = std::log(SPRT_BETA / (1 - SPRT_ALPHA));
+    const double upper_bound = std::log((1 - SPRT_BETA) / SPRT_ALPHA);
+
+    MatchStats stats;
+    stats.sides[0] = sides[0];
+    stats.sides[1] = sides[1];
+    std::mutex stats_mutex;
+    std::atomic<int> next_game{0};
+    std::atomic<bool> finished{false};
+    std::string sprt_result = "none";
+
+    Time start;
+    auto worker = [&]() {
+        while (!finished.load()) {
+            const int game = next_game.fetch_add(1);
+            if (game >= games) {
+                break;
+            }
+            Side game_sides[2] = {sides[0], sides[1]};
+            const int black_side = game % 2;
+            int moves;
+            const int winner = play_game(game_sides, black_side,
+                                             seeds[game / 2], moves);
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.games++;
+            (winner == 0 ? stats.a_wins : stats.b_wins)++;
+            for (int s = 0; s < 2; ++s) {
+                stats.sides[s].playouts += game_sides[s].playouts;
+                stats.sides[s].think_seconds += game_sides[s].think_seconds;
+            }
+
+            const double llr = compute_llr(stats.a_wins, stats.b_wins);
+            std::cout << "{\"game\": " << game
+                          << ", \"black\": \"" << (black_side == 0 ? "A" : "B") << "\""
+                          << ", \"winner\": \"" << (winner == 0 ? "A" : "B") << "\""
+                          << ", \"moves\": " << moves
+                          << ", \"llr\": " << llr << "}" << std::endl;
+
+            if (llr <= lower_bound || llr >= upper_bound) {
+                if (!finished.exchange(true)) {
+                    sprt_result = llr >= upper_bound ? "H1" : "H0";
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < std::max(cfg_match_parallel, 1); ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+    const double elapsed = Time::timediff_seconds(start, Time());
+
+    cfg_search_file = search_file;
+    if (null_file) {
+        fclose(null_file);
+    }
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "{\"games\": " << stats.games
+            << ", \"a_wins\": " << stats.a_wins
+            << ", \"b_wins\": " << stats.b_wins
+            << ", \"elo\": " << compute_elo(stats.a_wins, stats.b_wins)
+            << ", \"llr\": " << compute_llr(stats.a_wins, stats.b_wins)
+            << ", \"sprt\": {\"elo0\": " << cfg_sprt_elo0
+            << ", \"elo1\": " << cfg_sprt_elo1
+            << ", \"result\": \"" << sprt_result << "\"}"
+            << ", \"seconds\": " << elapsed
+            << ", \"sides\": {";
+    for (int s = 0; s < 2; ++s) {
+        const auto &side = stats.sides[s];
+        const double cpu_seconds = side.think_seconds * side.parameters.threads;
+        out << (s == 0 ? "\"A\": {" : ", \"B\": {")
+                << "\"threads\": " << side.parameters.threads
+                << ", \"playouts\": " << side.playouts
+                << ", \"think_seconds\": " << side.think_seconds
+                << ", \"cpu_seconds\": " << cpu_seconds
+                << ", \"playouts_per_cpu_second\": "
+                << side.playouts / std::max(cpu_seconds, 1e-6) << "}";
+    }
+    out << "}}";
+    std::cout << out.str() << std::endl;
+}
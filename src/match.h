@@ -0,0 +1,12 @@
+#ifndef MATCH_H_INCLUDE
+#define MATCH_H_INCLUDE
+
+// Play the engine against itself with the settings of side A and side
+// B. The games run concurrently, each with its own GameState and Search
+// per side. Every pair of games shares a random hollow layout and
+// opening with the colors swapped. The match stops early when the SPRT
+// accepts a hypothesis. Print one JSON line per game and a summary to
+// stdout.
+void run_match(int games);
+
+#endif
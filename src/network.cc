@@ -0,0 +1,463 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "network.h"
+
+// The batch thread waits at most NN_BATCH_WAIT_US for a full batch.
+#define NN_BATCH_WAIT_US (100)
+
+// The activations are quantized to 7 bits, so the pairwise sums of
+// _mm256_maddubs_epi16 do not saturate.
+#define NN_ACTIVATION_MAX (127)
+
+#define NN_WEIGHTS_VERSION (1)
+
+static int round_up(int n, int multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+static float dot_float(const float *a, const float *b, int size) {
+    int i = 0;
+    float sum = 0.f;
+#ifdef __AVX2__
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= size; i += 8) {
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                                   _mm256_loadu_ps(b + i)));
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, acc);
+    for (int k = 0; k < 8; ++k) {
+        sum += lanes[k];
+    }
+#endif
+    for (; i < size; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static int dot_int8(const std::uint8_t *a, const std::int8_t *b, int size) {
+    int i = 0;
+    int sum = 0;
+#ifdef __AVX2__
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= size; i += 32) {
+        const __m256i products = _mm256_maddubs_epi16(
+            _mm256_loadu_si256((const __m256i *)(a + i)),
+            _mm256_loadu_si256((const __m256i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(products, ones));
+    }
+    alignas(32) int lanes[8];
+    _mm256_store_si256((__m256i *)lanes, acc);
+    for (int k = 0; k < 8; ++k) {
+        sum += lanes[k];
+    }
+#endif
+    for (; i < size; ++i) {
+        sum += (int)a[i] * (int)b[i];
+    }
+    return sum;
+}
+
+static void relu(std::vector<float> &data) {
+    for (auto &v : data) {
+        v = std::max(v, 0.f);
+    }
+}
+
+static void fc_forward(const FullyConnectedLayer &layer, const float *input, float *output) {
+    for (int o = 0; o < layer.outputs; ++o) {
+        output[o] = layer.biases[o] +
+                        dot_float(layer.weights.data() + o * layer.inputs, input, layer.inputs);
+    }
+}
+
+Network &Network::get() {
+    static Network network;
+    return network;
+}
+
+Network::~Network() {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_running = false;
+    }
+    m_queue_cv.notify_all();
+    if (m_batch_thread.joinable()) {
+        m_batch_thread.join();
+    }
+}
+
+bool Network::is_loaded() const {
+    return m_loaded;
+}
+
+bool Network::load(std::string filename, bool use_int8) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        fprintf(stderr, "Fail to open the weights %s.\n", filename.c_str());
+        return false;
+    }
+
+    std::string line, name;
+    int version = 0, input_planes = 0;
+    if (!std::getline(file, line) ||
+            !(std::istringstream{line} >> name >> version) ||
+            name != "nogo-nn" || version != NN_WEIGHTS_VERSION) {
+        fprintf(stderr, "The weights %s are not version %d.\n",
+                    filename.c_str(), NN_WEIGHTS_VERSION);
+        return false;
+    }
+    if (!std::getline(file, line) ||
+            !(std::istringstream{line} >> input_planes >> m_channels >> m_blocks) ||
+            input_planes != NN_INPUT_PLANES || m_channels <= 0 || m_blocks < 0) {
+        fprintf(stderr, "The weights %s have the wrong shape.\n", filename.c_str());
+        return false;
+    }
+
+    auto read_tensor = [&file](std::vector<float> &tensor, int size) {
+        std::string tensor_line;
+        if (!std::getline(file, tensor_line)) {
+            return false;
+        }
+        std::istringstream ss{tensor_line};
+        tensor.clear();
+        float v;
+        while (ss >> v) {
+            tensor.emplace_back(v);
+        }
+        return (int)tensor.size() == size;
+    };
+
+    auto read_conv = [&read_tensor, use_int8](ConvLayer &layer,
+                                                  int inputs, int outputs, int filter_size) {
+        layer.inputs = inputs;
+        layer.outputs = outputs;
+        layer.filter_size = filter_size;
+
+        const int size = inputs * filter_size * filter_size;
+        layer.padded_size = round_up(size, 32);
+
+        std::vector<float> weights;
+        if (!read_tensor(weights, outputs * size) ||
+                !read_tensor(layer.biases, outputs)) {
+            return false;
+        }
+
+        // Pad every output row, so the dot products need no tail.
+        layer.weights.assign(outputs * layer.padded_size, 0.f);
+        layer.quantized_weights.assign(outputs * layer.padded_size, 0);
+        layer.scales.assign(outputs, 1.f);
+        for (int o = 0; o < outputs; ++o) {
+            float max_weight = 0.f;
+            for (int k = 0; k < size; ++k) {
+                const float w = weights[o * size + k];
+                layer.weights[o * layer.padded_size + k] = w;
+                max_weight = std::max(max_weight, std::abs(w));
+            }
+            if (!use_int8 || max_weight == 0.f) {
+                continue;
+            }
+            layer.scales[o] = max_weight / 127.f;
+            for (int k = 0; k < size; ++k) {
+                layer.quantized_weights[o * layer.padded_size + k] =
+                    (std::int8_t)std::round(weights[o * size + k] / layer.scales[o]);
+            }
+        }
+        return true;
+    };
+
+    auto read_fc = [&read_tensor](FullyConnectedLayer &layer, int inputs, int outputs) {
+        layer.inputs = inputs;
+        layer.outputs = outputs;
+        return read_tensor(layer.weights, inputs * outputs) &&
+                   read_tensor(layer.biases, outputs);
+    };
+
+    const int num_intersections = Board::NUM_INTESECTIONS;
+    bool success = read_conv(m_input_conv, NN_INPUT_PLANES, m_channels, 3);
+    m_residual_convs.resize(2 * m_blocks);
+    for (auto &conv : m_residual_convs) {
+        success = success && read_conv(conv, m_channels, m_channels, 3);
+    }
+    success = success &&
+                  read_conv(m_policy_conv, m_channels, 2, 1) &&
+                  read_fc(m_policy_fc, 2 * num_intersections, num_intersections) &&
+                  read_conv(m_value_conv, m_channels, 1, 1) &&
+                  read_fc(m_value_fc1, num_intersections, NN_VALUE_HIDDEN) &&
+                  read_fc(m_value_fc2, NN_VALUE_HIDDEN, 1);
+    if (!success) {
+        fprintf(stderr, "The weights %s are broken.\n", filename.c_str());
+        return false;
+    }
+
+    m_use_int8 = use_int8;
+    m_batch_size = std::max(cfg_nn_batch_size > 0 ? cfg_nn_batch_size : cfg_search_threads, 1);
+    m_loaded = true;
+
+    if (!m_running) {
+        m_running = true;
+        m_batch_thread = std::thread([this]() { batch_loop(); });
+    }
+
+    fprintf(cfg_search_file, "Load the %s network with %d channels and %d blocks.\n",
+                use_int8 ? "int8" : "float", m_channels, m_blocks);
+    return true;
+}
+
+void Network::encode(const GameState &state, float *planes, std::uint8_t *legal) {
+    const int num_intersections = Board::NUM_INTESECTIONS;
+    const int board_size = state.get_board_size();
+    const int color = state.get_tomove();
+    const int opponent = !color;
+
+    std::fill(planes, planes + NN_INPUT_PLANES * num_intersections, 0.f);
+    std::fill(legal, legal + num_intersections, 0);
+
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            const int idx = state.get_index(x, y);
+            const int vtx = state.get_vertex(x, y);
+            const int stone = state.get_state(vtx);
+
+            if (stone == color) {
+                planes[0 * num_intersections + idx] = 1.f;
+            } else if (stone == opponent) {
+                planes[1 * num_intersections + idx] = 1.f;
+            } else if (stone == Board::INVLD) {
+                planes[2 * num_intersections + idx] = 1.f;
+            } else {
+                if (state.board.legal_move(vtx, color)) {
+                    planes[3 * num_intersections + idx] = 1.f;
+                    legal[idx] = 1;
+                }
+                if (state.board.legal_move(vtx, opponent)) {
+                    planes[4 * num_intersections + idx] = 1.f;
+                }
+            }
+        }
+    }
+}
+
+void Network::conv_forward(const ConvLayer &layer, const std::vector<float> &input,
+                               std::vector<float> &output, int batch_size) const {
+    const int num_intersections = Board::NUM_INTESECTIONS;
+    const int board_size = Board::BOARD_SIZE;
+    const int filter_size = layer.filter_size;
+    const int half = filter_size / 2;
+    const int rows = batch_size * num_intersections;
+    const int padded_size = layer.padded_size;
+
+    // The activations of every position have their own scale, so the
+    // result does not depend on the other positions of the batch. They
+    // are quantized once before the unfolding copies them.
+    std::vector<float> input_scales(batch_size, 1.f);
+    std::vector<std::uint8_t> quantized_input;
+    if (m_use_int8) {
+        const int sample_size = layer.inputs * num_intersections;
+        quantized_input.resize(input.size());
+        for (int b = 0; b < batch_size; ++b) {
+            const float *sample = input.data() + b * sample_size;
+            float max_input = 0.f;
+            for (int i = 0; i < sample_size; ++i) {
+                max_input = std::max(max_input, sample[i]);
+            }
+            input_scales[b] = max_input > 0.f ? max_input / NN_ACTIVATION_MAX : 1.f;
+
+            const float inv_scale = 1.f / input_scales[b];
+            std::uint8_t *quantized = quantized_input.data() + b * sample_size;
+            for (int i = 0; i < sample_size; ++i) {
+                quantized[i] = (std::uint8_t)std::min(
+                    std::max((int)(sample[i] * inv_scale + 0.5f), 0), NN_ACTIVATION_MAX);
+            }
+        }
+    }
+
+    // Unfold the patches into rows: the k-th column of the row of a
+    // point is the input plane k / (filter_size^2) at the offset
+    // k % (filter_size^2), as in the weight order.
+    std::vector<float> columns;
+    std::vector<std::uint8_t> quantized_columns;
+    if (m_use_int8) {
+        quantized_columns.assign(rows * padded_size, 0);
+    } else {
+        columns.assign(rows * padded_size, 0.f);
+    }
+
+    for (int b = 0; b < batch_size; ++b) {
+        for (int y = 0; y < board_size; ++y) {
+            for (int x = 0; x < board_size; ++x) {
+                const int row = b * num_intersections + y * board_size + x;
+                int k = 0;
+                for (int c = 0; c < layer.inputs; ++c) {
+                    const int plane = (b * layer.inputs + c) * num_intersections;
+                    for (int fy = 0; fy < filter_size; ++fy) {
+                        for (int fx = 0; fx < filter_size; ++fx, ++k) {
+                            const int yy = y + fy - half;
+                            const int xx = x + fx - half;
+                            if (yy < 0 || xx < 0 || yy >= board_size || xx >= board_size) {
+                                continue;
+                            }
+                            const int offset = plane + yy * board_size + xx;
+                            if (m_use_int8) {
+                                quantized_columns[row * padded_size + k] = quantized_input[offset];
+                            } else {
+                                columns[row * padded_size + k] = input[offset];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    output.resize(batch_size * layer.outputs * num_intersections);
+    for (int row = 0; row < rows; ++row) {
+        const int b = row / num_intersections;
+        const int idx = row % num_intersections;
+        for (int o = 0; o < layer.outputs; ++o) {
+            float v;
+            if (m_use_int8) {
+                v = dot_int8(quantized_columns.data() + row * padded_size,
+                                 layer.quantized_weights.data() + o * padded_size,
+                                 padded_size) * input_scales[b] * layer.scales[o];
+            } else {
+                v = dot_float(columns.data() + row * padded_size,
+                                  layer.weights.data() + o * padded_size,
+                                  padded_size);
+            }
+            output[(b * layer.outputs + o) * num_intersections + idx] = v + layer.biases[o];
+        }
+    }
+}
+
+std::vector<Network::Result> Network::forward(const std::vector<float> &planes,
+                                                  const std::vector<std::uint8_t> &legal,
+                                                  int batch_size) {
+    const int num_intersections = Board::NUM_INTESECTIONS;
+    std::vector<float> x, t, u;
+
+    conv_forward(m_input_conv, planes, x, batch_size);
+    relu(x);
+    for (int i = 0; i < m_blocks; ++i) {
+        conv_forward(m_residual_convs[2*i], x, t, batch_size);
+        relu(t);
+        conv_forward(m_residual_convs[2*i+1], t, u, batch_size);
+        for (size_t k = 0; k < u.size(); ++k) {
+            u[k] = std::max(u[k] + x[k], 0.f);
+        }
+        std::swap(x, u);
+    }
+
+    std::vector<float> policy, value;
+    conv_forward(m_policy_conv, x, policy, batch_size);
+    relu(policy);
+    conv_forward(m_value_conv, x, value, batch_size);
+    relu(value);
+
+    std::vector<Result> results(batch_size);
+    std::array<float, Board::NUM_INTESECTIONS> logits;
+    std::array<float, NN_VALUE_HIDDEN> hidden;
+
+    for (int b = 0; b < batch_size; ++b) {
+        auto &result = results[b];
+        const auto *legal_moves = legal.data() + b * num_intersections;
+
+        // The softmax over the legal moves only.
+        fc_forward(m_policy_fc, policy.data() + b * 2 * num_intersections, logits.data());
+        float max_logit = -1e30f;
+        for (int idx = 0; idx < num_intersections; ++idx) {
+            if (legal_moves[idx]) {
+                max_logit = std::max(max_logit, logits[idx]);
+            }
+        }
+        float sum = 0.f;
+        for (int idx = 0; idx < num_intersections; ++idx) {
+            result.policy[idx] = legal_moves[idx] ? std::exp(logits[idx] - max_logit) : 0.f;
+            sum += result.policy[idx];
+        }
+        for (auto &p : result.policy) {
+            p = sum > 0.f ? p / sum : 0.f;
+        }
+
+        fc_forward(m_value_fc1, value.data() + b * num_intersections, hidden.data());
+        for (auto &h : hidden) {
+            h = std::max(h, 0.f);
+        }
+        float v;
+        fc_forward(m_value_fc2, hidden.data(), &v);
+        result.value = (std::tanh(v) + 1.f) / 2.f;
+    }
+    return results;
+}
+
+Network::Result Network::evaluate(const GameState &state) {
+    Request request;
+    request.planes.resize(NN_INPUT_PLANES * Board::NUM_INTESECTIONS);
+    request.legal.resize(Board::NUM_INTESECTIONS);
+    encode(state, request.planes.data(), request.legal.data());
+
+    auto future = request.result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_queue.emplace_back(&request);
+    }
+    m_queue_cv.notify_all();
+    return future.get();
+}
+
+void Network::batch_loop() {
+    const int num_intersections = Board::NUM_INTESECTIONS;
+    std::vector<Request *> batch;
+    std::vector<float> planes;
+    std::vector<std::uint8_t> legal;
+
+    while (true) {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cv.wait(lock, [this]() {
+                return !m_running || !m_queue.empty();
+            });
+            if (!m_running && m_queue.empty()) {
+                return;
+            }
+            // Give the other search threads a moment to fill the batch.
+            if ((int)m_queue.size() < m_batch_size) {
+                m_queue_cv.wait_for(lock, std::chrono::microseconds(NN_BATCH_WAIT_US),
+                                        [this]() {
+                                            return !m_running ||
+                                                       (int)m_queue.size() >= m_batch_size;
+                                        });
+            }
+            while (!m_queue.empty() && (int)batch.size() < m_batch_size) {
+                batch.emplace_back(m_queue.front());
+                m_queue.pop_front();
+            }
+        }
+
+        const int batch_size = batch.size();
+        planes.resize(batch_size * NN_INPUT_PLANES * num_intersections);
+        legal.resize(batch_size * num_intersections);
+        for (int b = 0; b < batch_size; ++b) {
+            std::copy(std::begin(batch[b]->planes), std::end(batch[b]->planes),
+                          planes.begin() + b * NN_INPUT_PLANES * num_intersections);
+            std::copy(std::begin(batch[b]->legal), std::end(batch[b]->legal),
+                          legal.begin() + b * num_intersections);
+        }
+
+        auto results = forward(planes, legal, batch_size);
+        for (int b = 0; b < batch_size; ++b) {
+            batch[b]->result.set_value(results[b]);
+        }
+    }
+}
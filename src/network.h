@@ -0,0 +1,124 @@
+#ifndef NETWORK_H_INCLUDE
+#define NETWORK_H_INCLUDE
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "config.h"
+#include "game_state.h"
+
+// The input planes: the stones of the side to move, the stones of the
+// opponent, the hollow points, the legal moves of the side to move and
+// the legal moves of the opponent.
+#define NN_INPUT_PLANES (5)
+
+// The hidden units of the value head.
+#define NN_VALUE_HIDDEN (32)
+
+// One convolution with the batch normalization folded into the bias.
+// The int8 weights are quantized per output channel at loading.
+struct ConvLayer {
+    int inputs{0};
+    int outputs{0};
+    int filter_size{0};
+
+    // The length of one im2col row, padded for the SIMD loops.
+    int padded_size{0};
+
+    std::vector<float> weights;
+    std::vector<float> biases;
+    std::vector<std::int8_t> quantized_weights;
+    std::vector<float> scales;
+};
+
+struct FullyConnectedLayer {
+    int inputs{0};
+    int outputs{0};
+    std::vector<float> weights;
+    std::vector<float> biases;
+};
+
+// A small residual value/policy network on the CPU. The search threads
+// submit their leaves to a queue and one thread evaluates them in
+// batches.
+class Network {
+public:
+    struct Result {
+        // The probabilities of the moves by board index. The illegal
+        // moves are zero.
+        std::array<float, Board::NUM_INTESECTIONS> policy;
+
+        // The win-rate of the side to move.
+        float value;
+    };
+
+    static Network &get();
+
+    static bool enabled() {
+        return !cfg_nn_weights_file.empty();
+    }
+
+    // Load the weight file. The file is text: the line "nogo-nn 1",
+    // the line "<input planes> <channels> <residual blocks>", then one
+    // line of floats per tensor in the order of forward().
+    bool load(std::string filename, bool use_int8);
+
+    bool is_loaded() const;
+
+    // Evaluate the position through the batching queue.
+    Result evaluate(const GameState &state);
+
+    // Evaluate the encoded positions at once.
+    std::vector<Result> forward(const std::vector<float> &planes,
+                                    const std::vector<std::uint8_t> &legal,
+                                    int batch_size);
+
+    // Fill the input planes of the position, NN_INPUT_PLANES planes of
+    // NUM_INTESECTIONS floats, and the legal moves of the side to move.
+    static void encode(const GameState &state, float *planes, std::uint8_t *legal);
+
+private:
+    struct Request {
+        std::vector<float> planes;
+        std::vector<std::uint8_t> legal;
+        std::promise<Result> result;
+    };
+
+    Network() = default;
+    ~Network();
+
+    void batch_loop();
+
+    void conv_forward(const ConvLayer &layer, const std::vector<float> &input,
+                          std::vector<float> &output, int batch_size) const;
+
+    int m_channels{0};
+    int m_blocks{0};
+    bool m_use_int8{true};
+    bool m_loaded{false};
+
+    ConvLayer m_input_conv;
+    std::vector<ConvLayer> m_residual_convs;
+    ConvLayer m_policy_conv;
+    FullyConnectedLayer m_policy_fc;
+    ConvLayer m_value_conv;
+    FullyConnectedLayer m_value_fc1;
+    FullyConnectedLayer m_value_fc2;
+
+    int m_batch_size{1};
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::deque<Request *> m_queue;
+    bool m_running{false};
+    std::thread m_batch_thread;
+};
+
+#endif
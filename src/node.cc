@@ -2,77 +2,446 @@
 #include <algorithm>
 #include <thread>
 #include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <limits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "node.h"
 #include "board.h"
 #include "config.h"
+#include "affinity.h"
+#include "profiler.h"
+#include "network.h"
+#include "random.h"
 
 #define LOCK(M) \
     std::lock_guard<std::mutex> lock(M);
 
-#define VIRTUAL_LOSS_COUNT (3)
+// The progressive widening adds about WIDENING_SCALE * sqrt(visits)
+// children to the first cfg_widening_base ones.
+#define WIDENING_SCALE (1.0f)
 
-Node::Node(int vertex) {
-    m_vertex = vertex;
+// The UCT terms are looked up from the tables while the visits are
+// small enough.
+#define UCT_TABLE_SIZE (1 << 16)
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int),
+                  "The statistics arrays are scanned as plain integers.");
+
+static const std::vector<float> sqrt_log2_table = []() {
+    std::vector<float> table(UCT_TABLE_SIZE);
+    table[0] = 0.f;
+    for (int n = 1; n < UCT_TABLE_SIZE; ++n) {
+        table[n] = std::sqrt(std::log2((float)n));
+    }
+    return table;
+}();
+
+static const std::vector<float> inv_sqrt_table = []() {
+    std::vector<float> table(UCT_TABLE_SIZE);
+    table[0] = 0.f;
+    for (int n = 1; n < UCT_TABLE_SIZE; ++n) {
+        table[n] = 1.f / std::sqrt((float)n);
+    }
+    return table;
+}();
+
+static inline float get_sqrt_log2(int n) {
+    if (n < UCT_TABLE_SIZE) {
+        return sqrt_log2_table[n];
+    }
+    return std::sqrt(std::log2((float)n));
 }
 
-Node::Node(Node &&n) {
-    m_vertex = n.m_vertex;
+static inline float get_inv_sqrt(int n) {
+    if (n < UCT_TABLE_SIZE) {
+        return inv_sqrt_table[n];
+    }
+    return 1.f / std::sqrt((float)n);
+}
+
+#define CACHE_LINE_INTS ((int)(CACHE_LINE_SIZE / sizeof(std::atomic<int>)))
+
+// Allocate the zeroed statistics into the buffer. If aligned, the array
+// starts at a cache line and the line after the end is not shared with
+// other data.
+static std::atomic<int> *allocate_stats(
+                             std::unique_ptr<std::atomic<int>[]> &buffer,
+                             int size, bool aligned) {
+    const int padding = aligned ? CACHE_LINE_INTS : 0;
+    buffer.reset(new std::atomic<int>[size + 2 * padding]);
+    for (int i = 0; i < size + 2 * padding; ++i) {
+        buffer[i].store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<int> *base = buffer.get();
+    if (aligned) {
+        const auto addr = reinterpret_cast<std::uintptr_t>(base);
+        const auto offset = (CACHE_LINE_SIZE - addr % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+        base += offset / sizeof(std::atomic<int>);
+    }
+    return base;
 }
 
+// Every block starts with a header which records its arena. Keep the
+// node after it aligned.
+struct alignas(std::max_align_t) BlockHeader {
+    int arena;
+};
+
+// The blocks only give the alignment of the header to the node.
+static_assert(alignof(Node) <= alignof(BlockHeader),
+                  "The node needs the extended alignment.");
+
+// The node memory is carved from large chunks. The pages of a chunk are
+// first touched by the thread which allocates it, so the OS places them
+// on the NUMA node of that thread.
+class NodeArena {
+public:
+    void *allocate(std::size_t size, int arena) {
+        LOCK(m_mtx);
+
+        if (m_free_blocks.empty()) {
+            const std::size_t align = alignof(BlockHeader);
+            const std::size_t block_size =
+                (sizeof(BlockHeader) + size + align - 1) / align * align;
+            char *chunk = new char[CHUNK_BLOCKS * block_size];
+            m_chunks.emplace_back(chunk);
+            for (int i = CHUNK_BLOCKS-1; i >= 0; --i) {
+                auto header = reinterpret_cast<BlockHeader *>(chunk + i * block_size);
+                header->arena = arena;
+                m_free_blocks.emplace_back(header);
+            }
+        }
+        void *block = m_free_blocks.back();
+        m_free_blocks.pop_back();
+        return block;
+    }
+
+    void deallocate(void *block) {
+        LOCK(m_mtx);
+        m_free_blocks.emplace_back(block);
+    }
+
+private:
+    static constexpr int CHUNK_BLOCKS = 1024;
+
+    std::mutex m_mtx;
+    std::vector<void *> m_free_blocks;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+};
+
+static NodeArena &get_arena(int arena) {
+    static std::vector<std::unique_ptr<NodeArena>> arenas = []() {
+        std::vector<std::unique_ptr<NodeArena>> out;
+        int num_arenas = Affinity::get().get_num_numa_nodes();
+        for (int i = 0; i < num_arenas; ++i) {
+            out.emplace_back(std::make_unique<NodeArena>());
+        }
+        return out;
+    }();
+    return *arenas[arena % arenas.size()];
+}
+
+void *Node::operator new(std::size_t size) {
+    BlockHeader *header;
+    const int arena = Affinity::get_thread_numa_node();
+    if (cfg_numa_arena && arena >= 0) {
+        header = static_cast<BlockHeader *>(get_arena(arena).allocate(size, arena));
+    } else {
+        // The thread which is not bound has no NUMA node of its own.
+        header = static_cast<BlockHeader *>(std::malloc(sizeof(BlockHeader) + size));
+        if (!header) {
+            throw std::bad_alloc();
+        }
+        header->arena = -1;
+    }
+    return header + 1;
+}
+
+void Node::operator delete(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+    if (header->arena < 0) {
+        std::free(header);
+    } else {
+        get_arena(header->arena).deallocate(header);
+    }
+}
+
+Node::Node(int vertex, Node *parent, int index) {
+    m_vertex = vertex;
+    m_parent = parent;
+    m_index = index;
+    if (!m_parent) {
+        m_root_stats = allocate_stats(m_root_stats_buffer, NUM_STATS, true);
+    }
+}
+
+Node::Node(Node &&n) : Node(n.m_vertex) {}
+
 Node::~Node() {
     for (Node *n : m_children) {
         delete n;
     }
 }
 
-bool Node::expand_children(GameState &state, int &eval) {
+bool Node::expand_children(GameState &state, int &eval,
+                               int static_eval, int static_margin) {
     LOCK(m_mtx);
 
     if (is_expanded()) {
         return false;
     }
 
-    int color = state.get_tomove();
-    auto legal_moves = state.get_legal_moves(color);
+    // The evaluation is timed as the rollout, apart from the expansion.
+    const int color = state.get_tomove();
+    const bool use_network = Network::get().is_loaded();
+    Network::Result result;
+    if (use_network) {
+        PROFILE_SCOPE(ROLLOUT);
+        result = Network::get().evaluate(state);
+    }
+
+    {
+        PROFILE_SCOPE(EXPANSION);
+        auto legal_moves = state.get_legal_moves(color);
+        const int size = legal_moves.size();
+
+        // The root and its children are updated by every thread.
+        const bool top_level = !m_parent || !m_parent->m_parent;
+        m_stats_stride = size;
+        if (top_level) {
+            m_stats_stride = (size + CACHE_LINE_INTS - 1) / CACHE_LINE_INTS * CACHE_LINE_INTS;
+        }
+        m_children_stats = allocate_stats(m_children_stats_buffer,
+                                              NUM_STATS * m_stats_stride, top_level);
+        m_num_children = size;
+
+        // The network policy or the cheap heuristic orders the children.
+        std::vector<float> priors(size);
+        if (use_network) {
+            for (int i = 0; i < size; ++i) {
+                const int vtx = legal_moves[i];
+                priors[i] = result.policy[state.get_index(state.get_x(vtx), state.get_y(vtx))];
+            }
+        } else if (cfg_widening_base > 0) {
+            for (int i = 0; i < size; ++i) {
+                priors[i] = state.get_move_prior(legal_moves[i], color);
+            }
+        }
+
+        std::vector<int> order(size);
+        for (int i = 0; i < size; ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(std::begin(order), std::end(order),
+                             [&priors](int a, int b) {
+                                 return priors[a] > priors[b];
+                             });
+
+        m_children_vertices = std::make_unique<int[]>(size);
+        if (use_network) {
+            m_children_priors = std::make_unique<float[]>(size);
+        }
+        for (int i = 0; i < size; ++i) {
+            m_children_vertices[i] = legal_moves[order[i]];
+            if (use_network) {
+                m_children_priors[i] = priors[order[i]];
+            }
+        }
+
+        // The children are allocated when they are widened. The vector
+        // never grows past its reserve, so the selection can read it
+        // while it is widened.
+        m_children.reserve(size);
+        widen_children(get_widening_target());
+    }
 
-    for (int vtx : legal_moves) {
-        m_children.emplace_back(new Node(vtx));
+    if (use_network) {
+        // The statistics count the wins, so draw one from the value.
+        const bool tomove_win =
+            PRNG::get().randuint32(1 << 16) < result.value * (1 << 16);
+        eval = tomove_win == (color == Board::BLACK);
+    } else {
+        // The rollout plays on the state, so it runs last.
+        PROFILE_SCOPE(ROLLOUT);
+        eval = state.evaluate(static_eval, static_margin);
     }
 
-    eval = state.rollouts();
     m_expanded.store(true, std::memory_order_release);
     return true;
 }
 
-Node *Node::uct_select_child(int color) {
-    wait_expanded();
+int Node::get_widening_target() const {
+    if (cfg_widening_base <= 0) {
+        return m_num_children;
+    }
+    const int target = cfg_widening_base +
+                           (int)(WIDENING_SCALE * std::sqrt((float)get_visits()));
+    return std::min(target, m_num_children);
+}
 
-    Node *best_node = nullptr;
-    double best_val = std::numeric_limits<double>::lowest();
+void Node::widen_children(int target) {
+    int widened = m_num_widened.load(std::memory_order_relaxed);
+    for (; widened < target; ++widened) {
+        m_children.emplace_back(new Node(m_children_vertices[widened], this, widened));
+    }
+    m_num_widened.store(widened, std::memory_order_release);
+}
 
-    int all_visits = 0;
-    for (Node *n : m_children) {
-        all_visits += n->get_visits();
+std::atomic<int> &Node::get_stat(stat_t stat) const {
+    if (m_parent) {
+        return m_parent->m_children_stats[
+                   stat * m_parent->m_stats_stride + m_index];
     }
-    all_visits = std::max(all_visits, 1);
+    return m_root_stats[stat];
+}
 
-    for (Node *n : m_children) {
-        int visits = n->get_visits();
-        double q = cfg_fpu_value;
-        if (visits > 0) {
-            q = n->get_eval(color, true);
+int Node::load_stat(stat_t stat) const {
+    return get_stat(stat).load(std::memory_order_relaxed);
+}
+
+void Node::compute_uct_scores(int color, float c_uct,
+                                  float fpu_value, float *scores) const {
+    // The WU-UCT counts the unobserved visits of the running playouts
+    // in the exploration term instead of adding a virtual loss.
+    const bool use_pending = (cfg_virtual_loss_mode == VIRTUAL_LOSS_WU_UCT);
+
+    int parent_visits = get_visits();
+    if (use_pending) {
+        parent_visits += get_pending();
+    }
+    const float numerator =
+        c_uct * get_sqrt_log2(std::max(parent_visits, 1));
+
+    // The counters are read without the atomic operations. It is as
+    // relaxed as the loads of the scalar version.
+    const int size = m_num_widened.load(std::memory_order_acquire);
+    const int stride = m_stats_stride;
+    const int *stats = reinterpret_cast<const int *>(m_children_stats);
+    const int *visits = stats + VISITS * stride;
+    const int *black_wins = stats + BLACK_WINS * stride;
+    const int *virtual_loss = stats + VIRTUAL_LOSS * stride;
+    const int *pending = stats + PENDING * stride;
+    const int *shared_visits = stats + SHARED_VISITS * stride;
+    const int *shared_black_wins = stats + SHARED_BLACK_WINS * stride;
+
+    int i = 0;
+#ifdef __AVX2__
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 fpu = _mm256_set1_ps(fpu_value);
+    const __m256 c_numerator = _mm256_set1_ps(numerator);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (; i + 8 <= size; i += 8) {
+        const __m256i v = _mm256_add_epi32(
+            _mm256_loadu_si256((const __m256i *)(visits + i)),
+            _mm256_loadu_si256((const __m256i *)(shared_visits + i)));
+        const __m256i w = _mm256_add_epi32(
+            _mm256_loadu_si256((const __m256i *)(black_wins + i)),
+            _mm256_loadu_si256((const __m256i *)(shared_black_wins + i)));
+        const __m256i vl = _mm256_loadu_si256((const __m256i *)(virtual_loss + i));
+
+        __m256 black_eval = _mm256_div_ps(
+            _mm256_cvtepi32_ps(w),
+            _mm256_max_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(v, vl)), one));
+        if (color == Board::WHITE) {
+            black_eval = _mm256_sub_ps(one, black_eval);
         }
-        double uct = q + cfg_c_uct *
-            std::sqrt(std::log2((double)all_visits)/(visits+1));
+        const __m256 visited = _mm256_castsi256_ps(_mm256_cmpgt_epi32(v, zero));
+        const __m256 q = _mm256_blendv_ps(fpu, black_eval, visited);
 
-        if (uct > best_val) {
-            best_val = uct;
-            best_node = n;
+        __m256i n = v;
+        if (use_pending) {
+            n = _mm256_add_epi32(
+                n, _mm256_loadu_si256((const __m256i *)(pending + i)));
         }
+        const __m256 explore = _mm256_div_ps(
+            c_numerator,
+            _mm256_sqrt_ps(_mm256_add_ps(_mm256_cvtepi32_ps(n), one)));
+
+        _mm256_storeu_ps(scores + i, _mm256_add_ps(q, explore));
     }
-    assert(best_node != nullptr);
-    return best_node;
+#endif
+
+    for (; i < size; ++i) {
+        const int v = visits[i] + shared_visits[i];
+        float q = fpu_value;
+        if (v > 0) {
+            const int w = black_wins[i] + shared_black_wins[i];
+            q = (float)w / (v + virtual_loss[i]);
+            if (color == Board::WHITE) {
+                q = 1.f - q;
+            }
+        }
+        int n = v;
+        if (use_pending) {
+            n += pending[i];
+        }
+        scores[i] = q + numerator * get_inv_sqrt(n+1);
+    }
+}
+
+void Node::compute_puct_scores(int color, float c_puct, float *scores) const {
+    const bool use_pending = (cfg_virtual_loss_mode == VIRTUAL_LOSS_WU_UCT);
+
+    int parent_visits = get_visits();
+    if (use_pending) {
+        parent_visits += get_pending();
+    }
+    const float numerator = c_puct * std::sqrt((float)std::max(parent_visits, 1));
+    const float parent_q = parent_visits > 0 ? get_eval(color) : 0.5f;
+
+    const int size = m_num_widened.load(std::memory_order_acquire);
+    for (int i = 0; i < size; ++i) {
+        const Node *child = m_children[i];
+        const int v = child->get_visits();
+        float q = parent_q;
+        if (v > 0) {
+            q = (float)child->get_black_wins() / (v + child->get_virtual_loss());
+            if (color == Board::WHITE) {
+                q = 1.f - q;
+            }
+        }
+        int n = v;
+        if (use_pending) {
+            n += child->get_pending();
+        }
+        scores[i] = q + numerator * m_children_priors[i] / (n + 1);
+    }
+}
+
+Node *Node::uct_select_child(int color, float c_uct, float fpu_value) {
+    wait_expanded();
+
+    if (get_widening_target() > m_num_widened.load(std::memory_order_acquire)) {
+        LOCK(m_mtx);
+        widen_children(get_widening_target());
+    }
+
+    alignas(32) float scores[Board::NUM_INTESECTIONS];
+    if (m_children_priors) {
+        compute_puct_scores(color, c_uct, scores);
+    } else {
+        compute_uct_scores(color, c_uct, fpu_value, scores);
+    }
+
+    const int size = m_num_widened.load(std::memory_order_acquire);
+    int best_idx = 0;
+    for (int i = 1; i < size; ++i) {
+        if (scores[i] > scores[best_idx]) {
+            best_idx = i;
+        }
+    }
+    assert(size > 0);
+    return m_children[best_idx];
 }
 
 int Node::get_vertex() const {
@@ -80,7 +449,20 @@ int Node::get_vertex() const {
 }
 
 int Node::get_visits() const {
-    return m_visits.load(std::memory_order_relaxed);
+    return load_stat(VISITS) + load_stat(SHARED_VISITS);
+}
+
+int Node::get_own_visits() const {
+    return load_stat(VISITS);
+}
+
+int Node::get_own_black_wins() const {
+    return load_stat(BLACK_WINS);
+}
+
+void Node::set_shared(int visits, int black_wins) {
+    get_stat(SHARED_VISITS).store(visits, std::memory_order_relaxed);
+    get_stat(SHARED_BLACK_WINS).store(black_wins, std::memory_order_relaxed);
 }
 
 std::vector<Node*> &Node::get_children() {
@@ -91,13 +473,20 @@ int Node::get_children_size() const {
     return m_children.size();
 }
 
+int Node::get_num_widened() const {
+    return m_num_widened.load(std::memory_order_acquire);
+}
+
+Node *Node::get_widened_child(int idx) const {
+    return m_children[idx];
+}
+
 double Node::get_eval(int color, bool use_virtual_loss) const {
     int visits = get_visits();
     if (use_virtual_loss) {
         visits += get_virtual_loss();
     }
-    double black_eval =
-        (double)m_black_wins.load(std::memory_order_relaxed)/visits;
+    double black_eval = (double)get_black_wins()/visits;
     if (color == Board::WHITE) {
         return 1. - black_eval;
     }
@@ -105,25 +494,58 @@ double Node::get_eval(int color, bool use_virtual_loss) const {
 }
 
 void Node::update(int eval) {
-    m_visits.fetch_add(1, std::memory_order_relaxed);
-    m_black_wins.fetch_add(eval, std::memory_order_relaxed);
+    get_stat(VISITS).fetch_add(1, std::memory_order_relaxed);
+    get_stat(BLACK_WINS).fetch_add(eval, std::memory_order_relaxed);
 }
 
-Node *Node::get_child(int vtx) {
+void Node::merge(int visits, int black_wins) {
+    get_stat(VISITS).fetch_add(visits, std::memory_order_relaxed);
+    get_stat(BLACK_WINS).fetch_add(black_wins, std::memory_order_relaxed);
+}
+
+int Node::get_black_wins() const {
+    return load_stat(BLACK_WINS) + load_stat(SHARED_BLACK_WINS);
+}
+
+Node *Node::find_child(int vtx) {
     for (Node *n : m_children) {
         if (n->get_vertex() == vtx) {
             return n;
         }
     }
+
+    // Widen the children up to the move if it is not allocated yet.
+    const int widened = m_num_widened.load(std::memory_order_relaxed);
+    for (int i = widened; i < m_num_children; ++i) {
+        if (m_children_vertices[i] == vtx) {
+            widen_children(i+1);
+            return m_children.back();
+        }
+    }
     return nullptr;
 }
 
+Node *Node::get_child(int vtx) {
+    LOCK(m_mtx);
+    return find_child(vtx);
+}
+
 Node *Node::pop_child(int vtx) {
     LOCK(m_mtx);
 
-    Node *n = get_child(vtx);
+    Node *n = find_child(vtx);
 
     if (n) {
+        // Move the statistics out of our arrays. This node should be
+        // released after popping.
+        auto root_stats = allocate_stats(n->m_root_stats_buffer, NUM_STATS, true);
+        for (int stat = 0; stat < NUM_STATS; ++stat) {
+            root_stats[stat].store(n->load_stat((stat_t)stat),
+                                       std::memory_order_relaxed);
+        }
+        n->m_root_stats = root_stats;
+        n->m_parent = nullptr;
+
         auto ite = std::remove_if(std::begin(m_children), std::end(m_children),
                                   [vtx](Node *a) {
                                       return a->get_vertex() == vtx;
@@ -135,17 +557,23 @@ Node *Node::pop_child(int vtx) {
 
 Node *Node::get_best_child() {
     wait_expanded();
-    sort_children();
-    return *std::begin(m_children);
-}
 
-void Node::sort_children() {
-    LOCK(m_mtx);
+    Node *best_node = nullptr;
+    for (Node *n : m_children) {
+        if (!best_node || n->get_visits() > best_node->get_visits()) {
+            best_node = n;
+        }
+    }
+    return best_node;
+}
 
-    std::sort(std::begin(m_children), std::end(m_children),
-              [](Node *a, Node *b) {
-                  return a->get_visits() > b->get_visits();
-              });
+std::vector<Node*> Node::get_sorted_children() {
+    auto children = m_children;
+    std::stable_sort(std::begin(children), std::end(children),
+                         [](Node *a, Node *b) {
+                             return a->get_visits() > b->get_visits();
+                         });
+    return children;
 }
 
 bool Node::is_expanded() const {
@@ -153,6 +581,10 @@ bool Node::is_expanded() const {
 }
 
 void Node::wait_expanded() {
+    if (is_expanded()) {
+        return;
+    }
+    PROFILE_SCOPE(WAIT_EXPANDED);
     while (m_expanded.load(std::memory_order_acquire) == false) {
         std::this_thread::yield();
     }
@@ -170,16 +602,20 @@ int Node::count_nodes() const {
     return val+1;
 }
 
-void Node::increment_virtual_loss() {
-    m_virtual_loss.fetch_add(
-        VIRTUAL_LOSS_COUNT, std::memory_order_relaxed);
+void Node::increment_virtual_loss(int count) {
+    get_stat(VIRTUAL_LOSS).fetch_add(count, std::memory_order_relaxed);
+    get_stat(PENDING).fetch_add(1, std::memory_order_relaxed);
 }
 
-void Node::decrement_virtual_loss() {
-    m_virtual_loss.fetch_sub(
-        VIRTUAL_LOSS_COUNT, std::memory_order_relaxed);
+void Node::decrement_virtual_loss(int count) {
+    get_stat(VIRTUAL_LOSS).fetch_sub(count, std::memory_order_relaxed);
+    get_stat(PENDING).fetch_sub(1, std::memory_order_relaxed);
 }
 
 int Node::get_virtual_loss() const {
-    return m_virtual_loss.load(std::memory_order_relaxed);
+    return load_stat(VIRTUAL_LOSS);
+}
+
+int Node::get_pending() const {
+    return load_stat(PENDING);
 }
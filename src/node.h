@@ -4,48 +4,143 @@
 #include <vector>
 #include <atomic>
 #include <cstdint>
+#include <cstddef>
 #include <mutex>
+#include <memory>
 
 #include "game_state.h"
+#include "config.h"
+#include "sharded_counter.h"
 
 class Node {
 public:
-    explicit Node(int vertex);
+    explicit Node(int vertex, Node *parent=nullptr, int index=0);
     explicit Node(Node &&n);
     ~Node();
 
-    bool expand_children(GameState &state, int &eval);
+    // Allocate the node from the NUMA node arena of the current thread
+    // if the arena is enabled and the thread is bound. Otherwise it
+    // comes from the global allocator.
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr);
 
-    Node *uct_select_child(int color);
+    // Expand the children and evaluate the node by the static_eval
+    // mode, one of the STATIC_EVAL_ modes. If the network is loaded, it
+    // gives the evaluation and the priors of the children instead.
+    bool expand_children(GameState &state, int &eval,
+                             int static_eval=STATIC_EVAL_NONE, int static_margin=0);
+
+    Node *uct_select_child(int color, float c_uct, float fpu_value);
     int get_vertex() const;
     int get_visits() const;
     double get_eval(int color, bool use_virtual_loss=false) const;
 
     void update(int val);
+
+    // Add the statistics which are searched by other processes.
+    void merge(int visits, int black_wins);
+    int get_black_wins() const;
+
+    // The statistics collected by this tree only, excluding the shared
+    // statistics from the other root parallel trees.
+    int get_own_visits() const;
+    int get_own_black_wins() const;
+    void set_shared(int visits, int black_wins);
     bool is_expanded() const;
-    void sort_children();
+
+    // Return the children sorted by visits. The children themselves
+    // keep the order of their statistics arrays. It, get_children(),
+    // count_nodes() and get_best_child() read the children vector
+    // directly, so they are only for the time no search runs.
+    std::vector<Node*> get_sorted_children();
 
     std::vector<Node*> &get_children();
     int get_children_size() const;
 
+    // The allocated children which may be read while the search widens
+    // the others. The storage is reserved, so the first
+    // get_num_widened() children never move.
+    int get_num_widened() const;
+    Node *get_widened_child(int idx) const;
+
     int count_nodes() const;
 
+    // Return the child of the move. It is widened if it is not yet.
     Node *get_child(int vtx);
     Node *pop_child(int vtx);
     Node *get_best_child();
 
-    void increment_virtual_loss();
-    void decrement_virtual_loss();
+    // Add the virtual loss and one in-flight visit of a running playout.
+    void increment_virtual_loss(int count);
+    void decrement_virtual_loss(int count);
     int get_virtual_loss() const;
 
+    // The number of the playouts which pass this node but are not
+    // finished yet.
+    int get_pending() const;
+
 private:
+    enum stat_t {
+        VISITS = 0,
+        BLACK_WINS,
+        VIRTUAL_LOSS,
+        PENDING,
+        SHARED_VISITS,
+        SHARED_BLACK_WINS,
+        NUM_STATS
+    };
+
     void wait_expanded();
 
+    // The selectable children by the visits of this node.
+    int get_widening_target() const;
+
+    // Allocate the children up to the target. The mutex should be held.
+    void widen_children(int target);
+
+    // get_child with the mutex held.
+    Node *find_child(int vtx);
+
+    // The statistic of this node. It lives in the arrays of the parent,
+    // or in the node itself if it has no parent.
+    std::atomic<int> &get_stat(stat_t stat) const;
+    int load_stat(stat_t stat) const;
+
+    // Compute the UCT scores of all children into scores.
+    void compute_uct_scores(int color, float c_uct,
+                                float fpu_value, float *scores) const;
+
+    // Compute the PUCT scores from the network priors. The unvisited
+    // children take the value of this node.
+    void compute_puct_scores(int color, float c_puct, float *scores) const;
+
     std::vector<Node*> m_children;
 
-    std::atomic<int> m_black_wins{0};
-    std::atomic<int> m_visits{0};
-    std::atomic<int> m_virtual_loss{0};
+    // The statistics of the children in structure-of-arrays layout. The
+    // i-th child's stat is at [stat * m_stats_stride + i], so the
+    // selection scans them contiguously. The arrays of the top-level
+    // nodes start at the cache lines, so the arrays updated by every
+    // thread do not share the lines with each other.
+    std::unique_ptr<std::atomic<int>[]> m_children_stats_buffer{nullptr};
+    std::atomic<int> *m_children_stats{nullptr};
+    int m_stats_stride{0};
+    int m_num_children{0};
+
+    // The moves of the children, ordered by the priors. Only the first
+    // m_num_widened children are allocated and selectable.
+    std::unique_ptr<int[]> m_children_vertices{nullptr};
+    std::atomic<int> m_num_widened{0};
+
+    // The policy priors of the children if the network is loaded.
+    std::unique_ptr<float[]> m_children_priors{nullptr};
+
+    // The statistics of the node without parent. They are on their own
+    // cache line, apart from the fields which the selection reads.
+    std::unique_ptr<std::atomic<int>[]> m_root_stats_buffer{nullptr};
+    std::atomic<int> *m_root_stats{nullptr};
+    Node *m_parent;
+    int m_index;
+
     std::atomic<bool> m_expanded{false};
     std::mutex m_mtx;
 
@@ -0,0 +1,129 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "perft.h"
+#include "time_manager.h"
+
+// The cache is split into shards to reduce the lock contention.
+#define PERFT_CACHE_SHARDS (64)
+#define PERFT_CACHE_MAX_ENTRIES (1 << 22)
+
+struct PerftCacheShard {
+    std::mutex mutex;
+    std::unordered_map<std::uint64_t, std::uint64_t> table;
+};
+
+static PerftCacheShard perft_cache[PERFT_CACHE_SHARDS];
+static std::atomic<int> perft_cache_entries{0};
+
+static std::uint64_t get_cache_key(GameState &state, int depth) {
+    std::uint64_t key = state.board.compute_hash();
+    key ^= (std::uint64_t)(state.get_tomove() + 1) * 0x9E3779B97F4A7C15ULL;
+    key ^= (std::uint64_t)depth * 0xC2B2AE3D27D4EB4FULL;
+    return key;
+}
+
+static bool probe_cache(std::uint64_t key, std::uint64_t &nodes) {
+    auto &shard = perft_cache[key % PERFT_CACHE_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.table.find(key);
+    if (it == std::end(shard.table)) {
+        return false;
+    }
+    nodes = it->second;
+    return true;
+}
+
+static void store_cache(std::uint64_t key, std::uint64_t nodes) {
+    if (perft_cache_entries.load(std::memory_order_relaxed) >= PERFT_CACHE_MAX_ENTRIES) {
+        return;
+    }
+    auto &shard = perft_cache[key % PERFT_CACHE_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.table.emplace(key, nodes).second) {
+        perft_cache_entries.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static std::uint64_t perft_recursive(GameState &state, int depth, bool use_cache) {
+    const int color = state.get_tomove();
+    auto legal_moves = state.get_legal_moves(color);
+
+    if (depth <= 1) {
+        // Count the leaves without playing them.
+        return depth == 1 ? legal_moves.size() : 1;
+    }
+
+    std::uint64_t key = 0;
+    std::uint64_t nodes = 0;
+    if (use_cache) {
+        key = get_cache_key(state, depth);
+        if (probe_cache(key, nodes)) {
+            return nodes;
+        }
+    }
+
+    for (int vtx : legal_moves) {
+        Board board = state.board;
+        state.play_move_fast(vtx, color);
+        nodes += perft_recursive(state, depth-1, use_cache);
+        state.board = board;
+    }
+
+    if (use_cache) {
+        store_cache(key, nodes);
+    }
+    return nodes;
+}
+
+PerftResult perft(GameState &state, int depth, int threads, bool use_cache) {
+    Time start;
+
+    const int color = state.get_tomove();
+    auto root_moves = state.get_legal_moves(color);
+
+    std::uint64_t nodes = 0;
+    if (depth <= 1) {
+        nodes = depth == 1 ? root_moves.size() : 1;
+    } else {
+        std::atomic<int> next_move{0};
+        std::atomic<std::uint64_t> total_nodes{0};
+
+        auto worker = [&]() {
+            GameState fork_state = state;
+            while (true) {
+                const int idx = next_move.fetch_add(1);
+                if (idx >= (int)root_moves.size()) {
+                    break;
+                }
+                Board board = fork_state.board;
+                fork_state.play_move_fast(root_moves[idx], color);
+                total_nodes.fetch_add(perft_recursive(fork_state, depth-1, use_cache));
+                fork_state.board = board;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 0; i < std::max(threads, 1); ++i) {
+            pool.emplace_back(worker);
+        }
+        for (auto &t : pool) {
+            t.join();
+        }
+        nodes = total_nodes.load();
+    }
+
+    return PerftResult{nodes, Time::timediff_seconds(start, Time())};
+}
+
+void clear_perft_cache() {
+    for (auto &shard : perft_cache) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.table.clear();
+    }
+    perft_cache_entries.store(0);
+}
@@ -0,0 +1,20 @@
+#ifndef PERFT_H_INCLUDE
+#define PERFT_H_INCLUDE
+
+#include <cstdint>
+
+#include "game_state.h"
+
+struct PerftResult {
+    std::uint64_t nodes;
+    double seconds;
+};
+
+// Count all legal move sequences of the given depth from the current
+// position. The root moves are split across the threads. The cache
+// keeps the counts of the inner positions across runs.
+PerftResult perft(GameState &state, int depth, int threads, bool use_cache);
+
+void clear_perft_cache();
+
+#endif
@@ -0,0 +1,108 @@
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+static const char *phase_names[Profiler::NUM_PHASES] = {
+    "selection", "expansion", "rollout", "backup", "wait_expanded"
+};
+#endif
+
+static std::uint64_t get_nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler &Profiler::get() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() {
+    clear();
+}
+
+std::uint64_t Profiler::get_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return get_nanos();
+#endif
+}
+
+Profiler::ThreadStats &Profiler::get_thread_stats() {
+    static thread_local ThreadStats *stats = nullptr;
+    if (!stats) {
+        const int idx = m_num_threads.fetch_add(1);
+        stats = &m_threads[std::min(idx, MAX_PROFILE_THREADS-1)];
+    }
+    return *stats;
+}
+
+void Profiler::add(phase_t phase, std::uint64_t ticks) {
+    auto &stats = get_thread_stats();
+    auto &count = stats.counts[phase];
+    auto &sum = stats.ticks[phase];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &stats : m_threads) {
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            stats.counts[p].store(0, std::memory_order_relaxed);
+            stats.ticks[p].store(0, std::memory_order_relaxed);
+        }
+    }
+    m_start_ticks = get_ticks();
+    m_start_nanos = get_nanos();
+}
+
+std::string Profiler::get_json() {
+    std::ostringstream out;
+#ifdef ENABLE_PROFILER
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::uint64_t counts[NUM_PHASES] = {0};
+    std::uint64_t ticks[NUM_PHASES] = {0};
+    const int num_threads = std::min(m_num_threads.load(), MAX_PROFILE_THREADS);
+    for (int i = 0; i < num_threads; ++i) {
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            counts[p] += m_threads[i].counts[p].load(std::memory_order_relaxed);
+            ticks[p] += m_threads[i].ticks[p].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Calibrate the ticks with the wall clock since the last clear.
+    const double elapsed_nanos = get_nanos() - m_start_nanos;
+    const double elapsed_ticks = get_ticks() - m_start_ticks;
+    const double seconds_per_tick =
+        elapsed_ticks > 0 ? elapsed_nanos / elapsed_ticks * 1e-9 : 0;
+
+    out << "{\"enabled\": true, "
+            << "\"timers\": " << (cfg_profile_timers ? "true" : "false") << ", "
+            << "\"threads\": " << num_threads << ", "
+            << "\"elapsed_seconds\": " << std::fixed << std::setprecision(6)
+            << elapsed_nanos * 1e-9 << ", "
+            << "\"phases\": {";
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        out << (p == 0 ? "" : ", ")
+                << "\"" << phase_names[p] << "\": {"
+                << "\"count\": " << counts[p] << ", "
+                << "\"ticks\": " << ticks[p] << ", "
+                << "\"seconds\": " << ticks[p] * seconds_per_tick << "}";
+    }
+    out << "}}";
+#else
+    out << "{\"enabled\": false}";
+#endif
+    return out.str();
+}
@@ -0,0 +1,89 @@
+#ifndef PROFILER_H_INCLUDE
+#define PROFILER_H_INCLUDE
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+#include "config.h"
+
+// The profiler is compiled in with -DENABLE_PROFILER. Otherwise the
+// PROFILE_* macros expand to nothing and the hot path pays nothing.
+#define MAX_PROFILE_THREADS (256)
+
+class Profiler {
+public:
+    enum phase_t {
+        SELECTION = 0,
+        EXPANSION,
+        ROLLOUT,
+        BACKUP,
+        WAIT_EXPANDED,
+        NUM_PHASES
+    };
+
+    // The counters of one thread. Only the owner thread writes them, so
+    // the update is a relaxed load and store without the locked
+    // instruction. Each thread has its own cache line.
+    struct alignas(64) ThreadStats {
+        std::atomic<std::uint64_t> counts[NUM_PHASES];
+        std::atomic<std::uint64_t> ticks[NUM_PHASES];
+    };
+
+    static Profiler &get();
+
+    // The time stamp counter, or nanoseconds if it is not available.
+    static std::uint64_t get_ticks();
+
+    void add(phase_t phase, std::uint64_t ticks);
+
+    // Sum up all threads and return the report as JSON.
+    std::string get_json();
+    void clear();
+
+private:
+    Profiler();
+
+    ThreadStats &get_thread_stats();
+
+    // The threads beyond MAX_PROFILE_THREADS share the last slot and
+    // may lose a few updates.
+    ThreadStats m_threads[MAX_PROFILE_THREADS];
+    std::atomic<int> m_num_threads{0};
+
+    std::mutex m_mutex;
+    std::uint64_t m_start_ticks;
+    std::uint64_t m_start_nanos;
+};
+
+#ifdef ENABLE_PROFILER
+
+// Count one phase, and time it if --profile-timers is set.
+class ProfileScope {
+public:
+    ProfileScope(Profiler::phase_t phase) :
+        m_phase(phase), m_start(cfg_profile_timers ? Profiler::get_ticks() : 0) {}
+
+    ~ProfileScope() {
+        Profiler::get().add(m_phase,
+            cfg_profile_timers ? Profiler::get_ticks() - m_start : 0);
+    }
+
+private:
+    Profiler::phase_t m_phase;
+    std::uint64_t m_start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(Profiler::phase)
+
+#else
+
+#define PROFILE_SCOPE(phase)
+
+#endif
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <limits>
+#include <atomic>
 #include <random>
 #include <thread>
 #include <cassert>
@@ -43,12 +44,47 @@ class PRNG : public RandomBase {
 public:
     PRNG(std::uint64_t seed) : s_(seed) { assert(seed); }
 
+    // The generator of the current thread. The threads which are not
+    // seeded explicitly take the next free stream.
     static PRNG &get() {
-        std::random_device rd_;
-        static thread_local PRNG rng(rd_());
+        static thread_local PRNG rng(get_stream_seed(next_stream().fetch_add(1)));
         return rng;
     }
 
+    // Set the seed of all streams. Zero means a random seed.
+    static void set_seed(std::uint64_t seed) {
+        global_seed() = seed;
+    }
+
+    // Restart the generator of the current thread with the given
+    // stream, so that the same thread always draws the same numbers.
+    static void seed_thread(std::uint64_t stream) {
+        get() = PRNG(get_stream_seed(stream));
+    }
+
+    // Reserve a block of STREAM_BLOCK_SIZE streams for the threads of
+    // one thread pool, so that the pools running at the same time never
+    // share a stream.
+    static std::uint64_t get_stream_block() {
+        return BLOCK_STREAMS + STREAM_BLOCK_SIZE * next_block().fetch_add(1);
+    }
+
+    static constexpr std::uint64_t STREAM_BLOCK_SIZE = 1 << 16;
+
+    // Derive an independent seed of the stream with split-mix.
+    static std::uint64_t get_stream_seed(std::uint64_t stream) {
+        std::uint64_t seed = global_seed();
+        if (seed == 0) {
+            std::random_device rd;
+            seed = ((std::uint64_t)rd() << 32) | rd();
+        }
+        std::uint64_t z = seed + (stream + 1) * 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z = z ^ (z >> 31);
+        return z ? z : 1;
+    }
+
     inline std::uint64_t rand64() {
         s_ ^= s_ >> 12;
         s_ ^= s_ << 25;
@@ -56,9 +92,46 @@ public:
         return s_ * 2685821657736338717LL;
     }
 
+    // Return a uniform integer in [0, bound) by the multiply and shift
+    // method with rejection. It avoids the division in most cases.
+    inline std::uint32_t randuint32(std::uint32_t bound) {
+        std::uint64_t m = (rand64() >> 32) * bound;
+        std::uint32_t low = (std::uint32_t)m;
+        if (low < bound) {
+            const std::uint32_t threshold = -bound % bound;
+            while (low < threshold) {
+                m = (rand64() >> 32) * bound;
+                low = (std::uint32_t)m;
+            }
+        }
+        return m >> 32;
+    }
+
     virtual std::uint64_t operator()() { return rand64(); }
 
 private:
+    // The streams below FREE_STREAMS are kept for the explicitly
+    // seeded threads.
+    static constexpr std::uint64_t FREE_STREAMS = 1 << 16;
+
+    // The blocks of the thread pools start far above the free streams.
+    static constexpr std::uint64_t BLOCK_STREAMS = 1ULL << 40;
+
+    static std::uint64_t &global_seed() {
+        static std::uint64_t seed = 0;
+        return seed;
+    }
+
+    static std::atomic<std::uint64_t> &next_stream() {
+        static std::atomic<std::uint64_t> stream{FREE_STREAMS};
+        return stream;
+    }
+
+    static std::atomic<std::uint64_t> &next_block() {
+        static std::atomic<std::uint64_t> block{0};
+        return block;
+    }
+
     std::uint64_t s_;
 };
 
@@ -0,0 +1,164 @@
+#include <algorithm>
+
+#include "scheduler.h"
+#include "search.h"
+#include "node.h"
+#include "affinity.h"
+#include "random.h"
+#include "tracer.h"
+#include "time_manager.h"
+#include "config.h"
+
+// The playouts of a job per turn of a thread.
+#define SCHEDULE_BATCH (16)
+
+SearchScheduler::SearchScheduler(int threads) {
+    m_stream_block = PRNG::get_stream_block();
+    for (int i = 0; i < std::max(threads, 1); ++i) {
+        m_pool.emplace_back(&SearchScheduler::worker, this, i);
+    }
+    m_pool.emplace_back(&SearchScheduler::gc_worker, this);
+    fprintf(cfg_search_file, "The shared search pool is ready with %d thread(s).\n",
+                get_num_threads());
+}
+
+SearchScheduler::~SearchScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running.store(false);
+    }
+    m_cv.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(m_gc_mutex);
+    }
+    m_gc_cv.notify_all();
+
+    for (auto &t : m_pool) {
+        t.join();
+    }
+}
+
+int SearchScheduler::get_num_threads() const {
+    return m_pool.size() - 1;
+}
+
+void SearchScheduler::add_job(Search *search, double weight) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.emplace_back(Job{search, std::max(weight, 1e-3), 0.0, 0});
+    }
+    m_cv.notify_all();
+}
+
+void SearchScheduler::remove_job(Search *search) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto ite = std::find_if(std::begin(m_jobs), std::end(m_jobs),
+                                [search](const Job &job) {
+                                    return job.search == search;
+                                });
+    if (ite == std::end(m_jobs)) {
+        return;
+    }
+
+    // Stop the new turns first, then wait for the running ones.
+    ite->weight = 0;
+    m_cv.wait(lock, [this, search]() {
+        for (const auto &job : m_jobs) {
+            if (job.search == search) {
+                return job.running == 0;
+            }
+        }
+        return true;
+    });
+    m_jobs.erase(std::remove_if(std::begin(m_jobs), std::end(m_jobs),
+                                    [search](const Job &job) {
+                                        return job.search == search;
+                                    }),
+                     std::end(m_jobs));
+}
+
+void SearchScheduler::release(Node *node) {
+    {
+        std::lock_guard<std::mutex> lock(m_gc_mutex);
+        m_garbage_nodes.emplace(node);
+    }
+    m_gc_cv.notify_one();
+}
+
+SearchScheduler::Job *SearchScheduler::pick_job() {
+    Job *best = nullptr;
+    for (auto &job : m_jobs) {
+        if (job.weight <= 0) {
+            continue;
+        }
+        if (!best || job.used_seconds / job.weight <
+                         best->used_seconds / best->weight) {
+            best = &job;
+        }
+    }
+    return best;
+}
+
+void SearchScheduler::worker(int thread_idx) {
+    Affinity::get().bind_thread(thread_idx, (Affinity::mode_t)cfg_thread_affinity);
+    PRNG::seed_thread(m_stream_block + thread_idx);
+    if (Tracer::enabled()) {
+        Tracer::get().set_thread_name("search " + std::to_string(thread_idx));
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        Job *job = nullptr;
+        m_cv.wait(lock, [this, &job]() {
+            job = pick_job();
+            return job || !m_running;
+        });
+        if (!m_running) {
+            break;
+        }
+
+        // The job vector may change while unlocked, so find the job by
+        // the search again afterwards.
+        Search *search = job->search;
+        job->running++;
+        lock.unlock();
+
+        Time start;
+        {
+            TraceScope scope("playouts");
+            search->run_batch(thread_idx, SCHEDULE_BATCH);
+        }
+        const double elapsed = Time::timediff_seconds(start, Time());
+
+        lock.lock();
+        for (auto &j : m_jobs) {
+            if (j.search == search) {
+                j.running--;
+                j.used_seconds += elapsed;
+            }
+        }
+        m_cv.notify_all();
+    }
+}
+
+void SearchScheduler::gc_worker() {
+    if (Tracer::enabled()) {
+        Tracer::get().set_thread_name("gc");
+    }
+    std::unique_lock<std::mutex> lock(m_gc_mutex);
+    while (true) {
+        m_gc_cv.wait(lock, [this]() {
+            return !m_garbage_nodes.empty() || !m_running;
+        });
+        if (m_garbage_nodes.empty() && !m_running) {
+            break;
+        }
+        while (!m_garbage_nodes.empty()) {
+            Node *n = m_garbage_nodes.front();
+            m_garbage_nodes.pop();
+            lock.unlock();
+            delete n;
+            lock.lock();
+        }
+    }
+}
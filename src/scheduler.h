@@ -0,0 +1,63 @@
+#ifndef SCHEDULER_H_INCLUDE
+#define SCHEDULER_H_INCLUDE
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class Search;
+class Node;
+
+// One pool of search threads shared by many Search objects. Every
+// running search is a job. A free thread takes the job which used the
+// least time relative to its weight, runs a batch of playouts and puts
+// it back, so the CPU is split by the weights.
+class SearchScheduler {
+public:
+    SearchScheduler(int threads);
+    ~SearchScheduler();
+
+    int get_num_threads() const;
+
+    void add_job(Search *search, double weight);
+
+    // Remove the job and wait until no thread runs it.
+    void remove_job(Search *search);
+
+    // Delete the node on the shared GC thread.
+    void release(Node *node);
+
+private:
+    struct Job {
+        Search *search;
+        double weight;
+        double used_seconds;
+        int running;
+    };
+
+    void worker(int thread_idx);
+    void gc_worker();
+
+    // Return the job to run, or nullptr if there is none.
+    Job *pick_job();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<Job> m_jobs;
+    std::atomic<bool> m_running{true};
+
+    std::mutex m_gc_mutex;
+    std::condition_variable m_gc_cv;
+    std::queue<Node *> m_garbage_nodes;
+
+    std::vector<std::thread> m_pool;
+
+    // The first random stream of the threads.
+    std::uint64_t m_stream_block{0};
+};
+
+#endif
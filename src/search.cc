@@ -2,13 +2,59 @@
 #include <sstream>
 #include <string>
 #include <iostream>
+#include <cmath>
 
 #include "search.h"
 #include "board.h"
 #include "config.h"
-
-Search::Search(GameState &state) : m_root_state(state) {
+#include "distributed.h"
+#include "affinity.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "random.h"
+#include "scheduler.h"
+#include "tree_cache.h"
+#include "book.h"
+#include "network.h"
+
+// The depth of the upper tree which is shared between the root
+// parallel trees.
+#define SHARE_DEPTH (2)
+
+// The adaptive virtual loss is tuned every ADAPT_INTERVAL playouts to
+// keep the collision rate between the low and high bounds.
+#define ADAPT_INTERVAL (1000)
+#define ADAPT_LOW_COLLISIONS (0.02)
+#define ADAPT_HIGH_COLLISIONS (0.1)
+
+// The controller checks the root every CHECK_CENTIS. The thinking time
+// is extended if the best move changed in the last quarter of the time
+// or the top two moves are within CLOSE_VALUE.
+#define CHECK_CENTIS (5)
+#define CLOSE_VALUE (0.02)
+
+// The search threads trace the playouts in batches of TRACE_BATCH.
+#define TRACE_BATCH (64)
+
+// The constants of the completed score of the sequential halving, as
+// in the Gumbel MuZero.
+#define HALVING_C_VISIT (50.f)
+#define HALVING_C_SCALE (1.f)
+
+// Keep the logits of the zero priors finite.
+#define HALVING_MIN_PRIOR (1e-3f)
+
+Search::Search(GameState &state, SearchParameters parameters,
+                   SearchScheduler *scheduler) :
+                   m_root_state(state), m_parameters(parameters),
+                   m_scheduler(scheduler) {
+    if (m_scheduler) {
+        m_parameters.threads = m_scheduler->get_num_threads();
+    }
     init_pool();
+    if (!cfg_master_address.empty()) {
+        m_master = std::make_unique<DistributedMaster>(cfg_master_address);
+    }
 }
 
 Search::~Search() {
@@ -22,21 +68,49 @@ Search::~Search() {
 }
 
 void Search::init_pool() {
-    auto search_worker = [this]() {
+    auto search_worker = [this](int thread_idx, int tree) {
+        PRNG::seed_thread(m_stream_block + thread_idx);
+        if (Tracer::enabled()) {
+            Tracer::get().set_thread_name("search " + std::to_string(thread_idx));
+        }
+        auto placement = Affinity::get().bind_thread(
+                             thread_idx, (Affinity::mode_t)cfg_thread_affinity);
+        if (cfg_thread_affinity != Affinity::NONE) {
+            fprintf(cfg_search_file, "Search thread %d: %s.\n",
+                        thread_idx, placement.c_str());
+        }
         while(m_pool_running.load(std::memory_order_relaxed)) {
-            m_search_monitor.wait();
+            m_search_monitor.wait([this]() {
+                return m_search_running.load(std::memory_order_relaxed) ||
+                           !m_pool_running.load(std::memory_order_relaxed);
+            });
             m_running_threads.fetch_add(
                 1, std::memory_order_relaxed);
             while (m_search_running.load(std::memory_order_relaxed)) {
-                do_one_playout();
+                TraceScope scope("playouts");
+                for (int i = 0; i < TRACE_BATCH &&
+                         m_search_running.load(std::memory_order_relaxed); ++i) {
+                    if (cfg_deterministic &&
+                            m_playouts.load() >= m_max_playouts) {
+                        // Do not run past the budget before the
+                        // controller stops us.
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    do_one_playout(m_root_nodes[tree].get(), thread_idx);
+                }
             }
             m_running_threads.fetch_sub(
                 1, std::memory_order_relaxed);
         }
     };
     auto gc_worker = [this]() {
+        if (Tracer::enabled()) {
+            Tracer::get().set_thread_name("gc");
+        }
         while(m_pool_running.load(std::memory_order_relaxed)) {
             m_gc_monitor.wait();
+            TraceScope scope("gc");
 
             while (true) {
                 Node *n = nullptr;
@@ -53,54 +127,124 @@ void Search::init_pool() {
         }
     };
 
+    // The search threads of every Search draw from their own streams,
+    // and the controller takes the one after them.
+    m_stream_block = PRNG::get_stream_block();
+    m_playouts.resize(m_parameters.threads);
+    m_collisions.resize(m_parameters.threads);
     m_running_threads.store(0, std::memory_order_relaxed);
+    m_search_running.store(false, std::memory_order_relaxed);
+    m_virtual_loss.store(get_initial_virtual_loss(), std::memory_order_relaxed);
     m_pool_running.store(true);
 
-    int num_search_threads = cfg_search_threads;
+    if (cfg_thread_affinity != Affinity::NONE || cfg_numa_arena) {
+        auto &affinity = Affinity::get();
+        fprintf(cfg_search_file, "Found %d cpu(s), %d socket(s) and %d NUMA node(s).\n",
+                    affinity.get_num_cpus(),
+                    affinity.get_num_sockets(),
+                    affinity.get_num_numa_nodes());
+    }
+
+    int num_search_threads = m_parameters.threads;
+    int num_trees = std::max(1, std::min(cfg_root_parallel_trees,
+                                             num_search_threads));
+    m_root_nodes.resize(num_trees);
+
+    if (m_scheduler) {
+        // The threads of the scheduler run our playouts.
+        return;
+    }
+
     for (int i = 0; i < num_search_threads; ++i) {
-        m_pool.emplace_back(search_worker);
+        m_pool.emplace_back(search_worker, i, i % num_trees);
     }
     m_pool.emplace_back(gc_worker);
     fprintf(cfg_search_file, "The search pool is ready\n");
+    if (num_trees > 1) {
+        fprintf(cfg_search_file, "Use %d root parallel trees.\n", num_trees);
+    }
 }
 
-void Search::time_setting(int main_time) {
-    m_time_manager.time_setting(main_time, cfg_lag_buffer);
+void Search::time_setting(int main_time, int byo_time,
+                              int byo_stones, int byo_periods) {
+    m_time_manager.time_setting(main_time, byo_time,
+                                    byo_stones, byo_periods, cfg_lag_buffer);
+}
+
+void Search::seed_controller() {
+    PRNG::seed_thread(m_stream_block + m_parameters.threads);
+}
+
+void Search::time_left(int color, int time, int stones) {
+    m_time_manager.time_left(color, time, stones);
 }
 
 int Search::think() {
+    if (Tracer::enabled()) {
+        Tracer::get().set_thread_name("controller");
+    }
+    TraceScope scope("think");
+    seed_controller();
+
+    if (Book::enabled()) {
+        const int book_move = Book::get().probe(m_root_state);
+        if (book_move != Board::NULL_VERTEX) {
+            // The planned time of the move is saved for the later moves.
+            const int color = m_root_state.get_tomove();
+            m_time_manager.clock(color, m_root_state);
+            m_time_manager.stop(color);
+            fprintf(cfg_search_file, "Play the book move.\n");
+            return book_move;
+        }
+    }
+
     prepare_root_node();
+    Node *root = m_root_nodes[0].get();
 
-    if (m_root_node->get_children_size() == 0) {
+    if (root->get_children_size() == 0) {
         fprintf(cfg_search_file, "No legal move. I will resign.\n");
         return Board::RESIGN;
     }
 
-    int max_playouts = cfg_playouts;
+    int max_playouts = m_parameters.playouts;
     int color = m_root_state.get_tomove();
 
     m_time_manager.clock(color, m_root_state);
     float thinking_time = m_time_manager.get_thinking_time(color);
     fprintf(cfg_search_file, "The thinking time is %.2f(sec).\n", thinking_time);
 
-    m_playouts.store(0, std::memory_order_relaxed);
-    m_search_running.store(true, std::memory_order_relaxed);
-    m_search_monitor.notify(true);
+    if (m_master) {
+        m_master->broadcast(m_root_state, max_playouts,
+                                (int)(100 * thinking_time));
+    }
 
-    while (m_playouts.load(std::memory_order_relaxed) < max_playouts) {
-        if (m_time_manager.should_stop(color)) {
-            break;
-        }
-        std::this_thread::yield();
+    m_best_move = Board::NULL_VERTEX;
+    m_best_changed_centis = 0;
+    m_next_check_centis = 0;
+
+    int halving_move = Board::NULL_VERTEX;
+    if (m_parameters.root_policy == ROOT_POLICY_HALVING) {
+        halving_move = run_sequential_halving(max_playouts, color);
+    } else {
+        // The shared scheduler gives more threads to the game with more
+        // time left.
+        run_search(max_playouts, [this, color, max_playouts]() {
+            return should_stop_search(color, max_playouts);
+        }, m_time_manager.get_time_left(color));
     }
 
-    m_search_running.store(false, std::memory_order_relaxed);
-    while (m_running_threads.load(std::memory_order_relaxed) != 0) {
-        std::this_thread::yield();
+    std::vector<RootStat> remote_stats;
+    if (m_master) {
+        remote_stats = m_master->gather();
+        merge_stats(root, remote_stats);
     }
 
     m_time_manager.stop(color);
 
+    if (TreeCache::enabled()) {
+        TreeCache::get().collect(root, m_root_state);
+    }
+
     if (cfg_dump_analysis) {
         dump_analysis();
     }
@@ -108,40 +252,400 @@ int Search::think() {
 
     fprintf(cfg_search_file,
         "Do %d playout(s). The win-rate is %.2f(%%). Time left is %.2f (sec).\n",
-        m_playouts.load(std::memory_order_relaxed),
-        100 * m_root_node->get_eval(color),
+        m_playouts.load(),
+        100 * root->get_eval(color),
         m_time_manager.get_time_left(color));
+    if (cfg_adaptive_time) {
+        fprintf(cfg_search_file, "The saved time is %.2f (sec).\n",
+                    m_time_manager.get_saved_time(color));
+    }
+
+    if (m_parameters.threads > 1) {
+        const int playouts = std::max(m_playouts.load(), 1);
+        const int collisions = m_collisions.load();
+        fprintf(cfg_search_file,
+            "Collisions: %d (%.2f%%). The virtual loss is %d.\n",
+            collisions, 100.f * collisions / playouts,
+            m_virtual_loss.load(std::memory_order_relaxed));
+    }
 
-    if (m_root_node->get_eval(color) < 0.2f && cfg_enable_resign) {
+    int best_move = halving_move;
+    if (root->get_eval(color) < 0.2f && cfg_enable_resign) {
         fprintf(cfg_search_file, "The Win-rate looks bad. I will resign.\n");
-        return Board::RESIGN;
+        best_move = Board::RESIGN;
+    } else if (best_move == Board::NULL_VERTEX) {
+        best_move = root->get_best_child()->get_vertex();
     }
-    Node *best_node = m_root_node->get_best_child();
-    int best_move = best_node->get_vertex();
+
+    // The remote statistics only count for this decision. The subtrees
+    // reused by the next move do not have them.
+    merge_stats(root, remote_stats, -1);
     return best_move;
 }
 
-void Search::do_one_playout() {
+void Search::do_forced_playout(Node *root, Node *child, int thread_idx) {
+    GameState curr_state = m_root_state; // copy
+    int eval;
+    int virtual_loss = m_virtual_loss.load(std::memory_order_relaxed);
+
+    root->increment_virtual_loss(virtual_loss);
+    curr_state.play_move(child->get_vertex(), curr_state.get_tomove());
+    if (playout_recursive(curr_state, child, eval, virtual_loss, thread_idx)) {
+        root->update(eval);
+        m_playouts.add(thread_idx, 1);
+    }
+    root->decrement_virtual_loss(virtual_loss);
+}
+
+int Search::run_sequential_halving(int max_playouts, int color) {
+    TraceScope scope("halving");
+
+    Node *root = m_root_nodes[0].get();
+    const auto legal_moves = m_root_state.get_legal_moves(color);
+
+    // The logits are the network policy or the cheap move priors.
+    std::vector<float> logits(legal_moves.size());
+    if (Network::get().is_loaded()) {
+        const auto result = Network::get().evaluate(m_root_state);
+        for (size_t i = 0; i < legal_moves.size(); ++i) {
+            const int vtx = legal_moves[i];
+            logits[i] = std::log(HALVING_MIN_PRIOR +
+                            result.policy[m_root_state.get_index(m_root_state.get_x(vtx),
+                                                                     m_root_state.get_y(vtx))]);
+        }
+    } else {
+        for (size_t i = 0; i < legal_moves.size(); ++i) {
+            logits[i] = std::log(HALVING_MIN_PRIOR +
+                                     m_root_state.get_move_prior(legal_moves[i], color));
+        }
+    }
+
+    struct Candidate {
+        Node *node;
+        float gumbel_logit;
+    };
+
+    // Sample the candidates without replacement by the Gumbel top-k.
+    auto &rng = PRNG::get();
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < legal_moves.size(); ++i) {
+        const double u = (rng.randuint32(1 << 24) + 0.5) / (1 << 24);
+        Node *node = root->get_child(legal_moves[i]);
+        if (node) {
+            candidates.emplace_back(Candidate{node, logits[i] - (float)std::log(-std::log(u))});
+        }
+    }
+    std::sort(std::begin(candidates), std::end(candidates),
+                  [](const Candidate &a, const Candidate &b) {
+                      return a.gumbel_logit > b.gumbel_logit;
+                  });
+    candidates.resize(std::min((int)candidates.size(), std::max(cfg_halving_candidates, 1)));
+
+    // The completed score. The value term grows with the visits, so the
+    // search overrides the prior once the candidates are well visited.
+    // The unvisited candidates take the value of the root.
+    auto get_score = [root, color](const Candidate &c, int max_visits) {
+        float q = root->get_visits() > 0 ? root->get_eval(color) : 0.5f;
+        if (c.node->get_visits() > 0) {
+            q = c.node->get_eval(color);
+        }
+        return c.gumbel_logit + (HALVING_C_VISIT + max_visits) * HALVING_C_SCALE * q;
+    };
+
+    int phases = 0;
+    for (int n = 1; n < (int)candidates.size(); n *= 2) {
+        ++phases;
+    }
+
+    // The search threads run the visits of one candidate at a time.
+    auto should_stop = [this, color]() {
+        return !cfg_deterministic && m_time_manager.should_stop(color);
+    };
+    int used = 0;
+    int collisions = 0;
+    bool time_up = false;
+    for (int phase = 0; phase < phases && !time_up; ++phase) {
+        const int remaining_phases = phases - phase;
+        const int visits = std::max(
+            (max_playouts - used) / (remaining_phases * (int)candidates.size()), 1);
+
+        for (auto &c : candidates) {
+            m_forced_child.store(c.node, std::memory_order_relaxed);
+            run_search(visits, should_stop);
+            used += m_playouts.load();
+            collisions += m_collisions.load();
+            time_up = should_stop();
+            if (time_up) {
+                break;
+            }
+        }
+        m_forced_child.store(nullptr, std::memory_order_relaxed);
+
+        int max_visits = 0;
+        for (auto &c : candidates) {
+            max_visits = std::max(max_visits, c.node->get_visits());
+        }
+        std::stable_sort(std::begin(candidates), std::end(candidates),
+                             [&get_score, max_visits](const Candidate &a, const Candidate &b) {
+                                 return get_score(a, max_visits) > get_score(b, max_visits);
+                             });
+        if (!time_up) {
+            candidates.resize((candidates.size() + 1) / 2);
+        }
+    }
+
+    // Every run_search() restarts the counters. Keep the totals for the
+    // report of think().
+    m_playouts.reset();
+    m_playouts.add(0, used);
+    m_collisions.reset();
+    m_collisions.add(0, collisions);
+
+    fprintf(cfg_search_file, "The sequential halving did %d playout(s) in %d phase(s).\n",
+                used, phases);
+    return candidates[0].node->get_vertex();
+}
+
+void Search::run_search(int max_playouts,
+                            std::function<bool()> should_stop,
+                            double weight) {
+    TraceScope scope("search");
+    m_playouts.reset();
+    m_collisions.reset();
+    m_max_playouts = max_playouts;
+    m_search_running.store(true, std::memory_order_relaxed);
+    if (m_scheduler) {
+        m_scheduler->add_job(this, weight);
+    } else {
+        m_search_monitor.notify(true);
+    }
+
+    int next_share = cfg_root_share_interval;
+    int next_adapt = ADAPT_INTERVAL;
+    int last_collisions = 0;
+    while (m_playouts.load() < max_playouts) {
+        if (should_stop()) {
+            break;
+        }
+        const int playouts = m_playouts.load();
+        if (cfg_root_share_interval > 0 && playouts >= next_share) {
+            share_trees();
+            next_share += cfg_root_share_interval;
+        }
+        if (cfg_virtual_loss_mode == VIRTUAL_LOSS_ADAPTIVE &&
+                playouts >= next_adapt) {
+            const int collisions = m_collisions.load();
+            adapt_virtual_loss(
+                (double)(collisions - last_collisions) / ADAPT_INTERVAL);
+            last_collisions = collisions;
+            next_adapt += ADAPT_INTERVAL;
+        }
+        std::this_thread::yield();
+    }
+
+    m_search_running.store(false, std::memory_order_relaxed);
+    if (m_scheduler) {
+        m_scheduler->remove_job(this);
+    }
+    while (m_running_threads.load(std::memory_order_relaxed) != 0) {
+        std::this_thread::yield();
+    }
+    share_trees();
+}
+
+std::vector<RootStat> Search::subsearch(int max_playouts, int thinking_centis,
+                                            std::function<bool()> interrupt) {
+    seed_controller();
+    prepare_root_node();
+
+    Time start;
+    run_search(max_playouts, [start, thinking_centis, &interrupt]() {
+        return Time::timediff_centis(start, Time()) > thinking_centis ||
+                   (interrupt && interrupt());
+    }, thinking_centis / 100.0);
+    m_last_state = m_root_state;
+
+    std::vector<RootStat> stats;
+    for (Node *n : m_root_nodes[0]->get_children()) {
+        if (n->get_visits() > 0) {
+            stats.emplace_back(RootStat{
+                n->get_vertex(), n->get_visits(), n->get_black_wins()});
+        }
+    }
+    return stats;
+}
+
+int Search::get_playouts() const {
+    return m_playouts.load();
+}
+
+void Search::merge_stats(Node *root, const std::vector<RootStat> &stats, int sign) {
+    for (const auto &stat : stats) {
+        Node *n = root->get_child(stat.vertex);
+        if (n) {
+            n->merge(sign * stat.visits, sign * stat.black_wins);
+            root->merge(sign * stat.visits, sign * stat.black_wins);
+        }
+    }
+}
+
+bool Search::should_stop_search(int color, int max_playouts) {
+    if (cfg_deterministic) {
+        return false;
+    }
+    const bool time_up = m_time_manager.should_stop(color);
+
+    // The statistics of the main tree are not complete if the root
+    // parallel trees are not shared during the search.
+    if (!cfg_adaptive_time ||
+            (m_root_nodes.size() > 1 && cfg_root_share_interval <= 0)) {
+        return time_up;
+    }
+
+    const int elapsed_centis = m_time_manager.get_elapsed_centis(color);
+    if (!time_up && elapsed_centis < m_next_check_centis) {
+        return false;
+    }
+    m_next_check_centis = elapsed_centis + CHECK_CENTIS;
+
+    // The search is still running and may widen the root.
+    Node *root = m_root_nodes[0].get();
+    const int num_widened = root->get_num_widened();
+    Node *best_node = nullptr;
+    Node *second_node = nullptr;
+    for (int i = 0; i < num_widened; ++i) {
+        Node *n = root->get_widened_child(i);
+        if (!best_node || n->get_visits() > best_node->get_visits()) {
+            second_node = best_node;
+            best_node = n;
+        } else if (!second_node || n->get_visits() > second_node->get_visits()) {
+            second_node = n;
+        }
+    }
+    if (!second_node || second_node->get_visits() == 0) {
+        return time_up;
+    }
+
+    if (best_node->get_vertex() != m_best_move) {
+        m_best_move = best_node->get_vertex();
+        m_best_changed_centis = elapsed_centis;
+    }
+
+    if (time_up) {
+        const bool unstable =
+            4 * (elapsed_centis - m_best_changed_centis) < elapsed_centis;
+        const bool close =
+            std::abs(best_node->get_eval(color) -
+                         second_node->get_eval(color)) < CLOSE_VALUE;
+
+        if ((unstable || close) && m_time_manager.extend_thinking_time(color)) {
+            fprintf(cfg_search_file, "The best move is %s. Extend the thinking time to %.2f(sec).\n",
+                        unstable ? "unstable" : "close to the second",
+                        m_time_manager.get_thinking_centis(color) / 100.f);
+            return false;
+        }
+        return true;
+    }
+
+    // Estimate how many playouts are left from the measured rate. The
+    // rate is unknown before the first playout, but the reused or the
+    // seeded root may have the visits already.
+    const int playouts = m_playouts.load();
+    if (playouts == 0) {
+        return false;
+    }
+    const double rate = (double)playouts / std::max(elapsed_centis, 1);
+    const double remaining_centis =
+        m_time_manager.get_thinking_centis(color) - elapsed_centis;
+    const double remaining_playouts =
+        std::min((double)(max_playouts - playouts), rate * remaining_centis);
+
+    if (best_node->get_visits() - second_node->get_visits() > remaining_playouts) {
+        fprintf(cfg_search_file, "The second move can not catch the best move. Stop early.\n");
+        return true;
+    }
+    return false;
+}
+
+int Search::get_initial_virtual_loss() const {
+    if (cfg_virtual_loss_mode == VIRTUAL_LOSS_WU_UCT) {
+        return 0;
+    } else if (cfg_virtual_loss_mode == VIRTUAL_LOSS_ADAPTIVE) {
+        // More threads need the larger virtual loss to spread them.
+        return std::max(cfg_virtual_loss,
+                   (int)std::round(cfg_virtual_loss * std::sqrt(m_parameters.threads / 4.0)));
+    }
+    return cfg_virtual_loss;
+}
+
+void Search::adapt_virtual_loss(double collision_rate) {
+    const int max_virtual_loss = 4 * get_initial_virtual_loss();
+    int virtual_loss = m_virtual_loss.load(std::memory_order_relaxed);
+
+    if (collision_rate > ADAPT_HIGH_COLLISIONS) {
+        virtual_loss = std::min(virtual_loss+1, max_virtual_loss);
+    } else if (collision_rate < ADAPT_LOW_COLLISIONS) {
+        virtual_loss = std::max(virtual_loss-1, 1);
+    }
+    m_virtual_loss.store(virtual_loss, std::memory_order_relaxed);
+}
+
+void Search::do_one_playout(Node *root, int thread_idx) {
+    Node *forced_child = m_forced_child.load(std::memory_order_relaxed);
+    if (forced_child) {
+        // The sequential halving visits the child of the main tree. Its
+        // budgets are small, so do not run past them.
+        if (m_playouts.load() >= m_max_playouts) {
+            std::this_thread::yield();
+        } else {
+            do_forced_playout(m_root_nodes[0].get(), forced_child, thread_idx);
+        }
+        return;
+    }
+
     GameState curr_state = m_root_state; // copy
     int eval;
+    int virtual_loss = m_virtual_loss.load(std::memory_order_relaxed);
 
-    if (playout_recursive(curr_state, m_root_node.get(), eval)) {
-        m_playouts.fetch_add(1, std::memory_order_relaxed);
+    if (playout_recursive(curr_state, root, eval, virtual_loss, thread_idx)) {
+        m_playouts.add(thread_idx, 1);
     }
 }
 
-bool Search::playout_recursive(GameState &curr_state, Node *node, int &eval) {
-    node->increment_virtual_loss();
+void Search::run_batch(int thread_idx, int count) {
+    Node *root = m_root_nodes[thread_idx % m_root_nodes.size()].get();
+    for (int i = 0; i < count &&
+             m_search_running.load(std::memory_order_relaxed); ++i) {
+        if (cfg_deterministic && m_playouts.load() >= m_max_playouts) {
+            break;
+        }
+        do_one_playout(root, thread_idx);
+    }
+}
+
+bool Search::playout_recursive(GameState &curr_state, Node *node,
+                                   int &eval, int virtual_loss, int thread_idx) {
+    node->increment_virtual_loss(virtual_loss);
     bool success = true;
     int color = curr_state.get_tomove();
 
     if (node->is_expanded()) {
         // not leaf
-        Node *next = node->uct_select_child(color);
+        Node *next = nullptr;
+        {
+            PROFILE_SCOPE(SELECTION);
+            next = node->uct_select_child(color, m_parameters.c_uct,
+                                              m_parameters.fpu_value);
+        }
         curr_state.play_move(next->get_vertex(), color);
-        success = playout_recursive(curr_state, next, eval);
+        success = playout_recursive(curr_state, next, eval,
+                                        virtual_loss, thread_idx);
     } else {
         // leaf 
+        if (node->get_pending() > 1) {
+            // The other threads are evaluating the same leaf.
+            m_collisions.add(thread_idx, 1);
+        }
         if (curr_state.is_gameover(color)) {
             if (color == Board::BLACK) {
                 eval = 0; // white won
@@ -149,38 +653,68 @@ bool Search::playout_recursive(GameState &curr_state, Node *node, int &eval) {
                 eval = 1; // black won
             }
         } else {
-            if (node->get_visits() < cfg_node_expanding_thres) {
-                eval = curr_state.rollouts();
+            // The network evaluates the leaf by expanding it.
+            if (node->get_visits() < cfg_node_expanding_thres &&
+                    !Network::get().is_loaded()) {
+                PROFILE_SCOPE(ROLLOUT);
+                eval = curr_state.evaluate(m_parameters.static_eval,
+                                               m_parameters.static_margin);
             } else {
-                success = node->expand_children(curr_state, eval);
+                // It times its evaluation as the rollout.
+                success = node->expand_children(curr_state, eval,
+                                                    m_parameters.static_eval,
+                                                    m_parameters.static_margin);
             }
         }
     }
 
-    if (success) {
-        node->update(eval);
+    {
+        PROFILE_SCOPE(BACKUP);
+        if (success) {
+            node->update(eval);
+        }
+        node->decrement_virtual_loss(virtual_loss);
     }
-    node->decrement_virtual_loss();
 
     return success; // true
 }
 
 void Search::prepare_root_node() {
+    TraceScope scope("prepare");
     bool reused = advance_to_new_rootstate();
 
     if (!reused) {
         release_tree();
-        m_root_node = std::make_unique<Node>(Board::NULL_VERTEX);
-
-        int eval;
-        m_root_node->expand_children(m_root_state, eval);
-        m_root_node->update(eval);
+        for (auto &root : m_root_nodes) {
+            root = std::make_unique<Node>(Board::NULL_VERTEX);
+
+            int eval;
+            root->expand_children(m_root_state, eval,
+                                      m_parameters.static_eval,
+                                      m_parameters.static_margin);
+            root->update(eval);
+        }
+        if (TreeCache::enabled()) {
+            // The other trees get the seeded statistics by sharing.
+            TreeCache::get().seed(m_root_nodes[0].get(), m_root_state);
+        }
     } else {
-        fprintf(cfg_search_file, "Reused %d nodes.\n", m_root_node->count_nodes());
+        int reused_nodes = 0;
+        for (auto &root : m_root_nodes) {
+            reused_nodes += root->count_nodes();
+        }
+        fprintf(cfg_search_file, "Reused %d nodes.\n", reused_nodes);
     }
+
+    // The shared statistics of reused trees may be out of date.
+    share_trees();
 }
 
 void Search::release_node(Node *n) {
+    if (m_scheduler) {
+        m_scheduler->release(n);
+        return;
+    }
     {
         std::unique_lock<std::mutex> lock(m_queue_mutex);
         m_garbage_nodes.emplace(n);
@@ -189,15 +723,20 @@ void Search::release_node(Node *n) {
 }
 
 void Search::release_tree() {
-    if (m_root_node) {
-        Node *p = m_root_node.release();
-        release_node(p);
+    TraceScope scope("release");
+    for (auto &root : m_root_nodes) {
+        if (root) {
+            Node *p = root.release();
+            release_node(p);
+        }
     }
 }
 
 bool Search::advance_to_new_rootstate() {
-    if (!m_root_node) {
-        return false;
+    for (auto &root : m_root_nodes) {
+        if (!root) {
+            return false;
+        }
     }
 
     const int depth =
@@ -207,10 +746,10 @@ bool Search::advance_to_new_rootstate() {
         return false;
     }
 
-    std::stack<int> move_list;
+    std::stack<int> move_stack;
     GameState test = m_root_state;
     for (auto i = 0; i < depth; ++i) {
-        move_list.emplace(test.get_last_move());
+        move_stack.emplace(test.get_last_move());
         test.undo_move();
     }
 
@@ -219,22 +758,32 @@ bool Search::advance_to_new_rootstate() {
         return false;
     }
 
-    while (!move_list.empty()) {
-        int vtx = move_list.top();
-        int color = m_last_state.get_tomove();
+    std::vector<int> move_list;
+    while (!move_stack.empty()) {
+        move_list.emplace_back(move_stack.top());
+        move_stack.pop();
+    }
 
-        Node *next = m_root_node->pop_child(vtx);
-        Node *p = m_root_node.release();
-        release_node(p);
+    for (auto &root : m_root_nodes) {
+        for (int vtx : move_list) {
+            Node *next = root->pop_child(vtx);
+            Node *p = root.release();
+            release_node(p);
 
-        if (next) {
-            m_root_node.reset(next);
-        } else {
+            if (next) {
+                root.reset(next);
+            } else {
+                return false;
+            }
+        }
+        if (!root->is_expanded()) {
             return false;
         }
+    }
 
+    for (int vtx : move_list) {
+        int color = m_last_state.get_tomove();
         m_last_state.play_move(vtx, color);
-        move_list.pop();
     }
 
     if (m_root_state.board.compute_hash() !=
@@ -242,11 +791,56 @@ bool Search::advance_to_new_rootstate() {
         return false;
     }
 
-    if (!m_root_node->is_expanded()) {
-        return false;
+    return true;
+}
+
+void Search::share_trees() {
+    if (m_root_nodes.size() <= 1) {
+        return;
     }
 
-    return true;
+    std::vector<Node *> nodes;
+    for (auto &root : m_root_nodes) {
+        nodes.emplace_back(root.get());
+    }
+    share_nodes(nodes, SHARE_DEPTH);
+}
+
+void Search::share_nodes(std::vector<Node *> &nodes, int depth) {
+    int all_visits = 0;
+    int all_black_wins = 0;
+    for (Node *n : nodes) {
+        all_visits += n->get_own_visits();
+        all_black_wins += n->get_own_black_wins();
+    }
+    for (Node *n : nodes) {
+        n->set_shared(all_visits - n->get_own_visits(),
+                          all_black_wins - n->get_own_black_wins());
+    }
+
+    if (depth <= 0) {
+        return;
+    }
+    for (Node *n : nodes) {
+        if (!n->is_expanded()) {
+            return;
+        }
+    }
+
+    // All trees expand the same legal moves for the same position. The
+    // search threads may widen the nodes meanwhile.
+    const int num_widened = nodes[0]->get_num_widened();
+    for (int i = 0; i < num_widened; ++i) {
+        const int vtx = nodes[0]->get_widened_child(i)->get_vertex();
+        std::vector<Node *> next_nodes;
+        for (Node *n : nodes) {
+            Node *next = n->get_child(vtx);
+            if (next) {
+                next_nodes.emplace_back(next);
+            }
+        }
+        share_nodes(next_nodes, depth-1);
+    }
 }
 
 void Search::dump_analysis() {
@@ -269,8 +863,8 @@ void Search::dump_analysis() {
     };
 
     std::ostringstream ss;
-    m_root_node->sort_children();
-    std::vector<Node*> children = m_root_node->get_children();
+    Node *root = m_root_nodes[0].get();
+    std::vector<Node*> children = root->get_sorted_children();
 
     int max_show_size = std::min((int)children.size(), 10);
     int color = m_root_state.get_tomove();
@@ -289,10 +883,10 @@ void Search::dump_analysis() {
     }
 
     ss << "Tree has "
-           << m_root_node->count_nodes()
+           << root->count_nodes()
            << " visited nodes." << std::endl;
     ss << "The root visits is "
-           << m_root_node->get_visits()
+           << root->get_visits()
            << "." << std::endl;
     fprintf(cfg_search_file, "%s", ss.str().c_str());
 }
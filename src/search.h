@@ -6,30 +6,90 @@
 #include <mutex>
 #include <thread>
 #include <condition_variable>
+#include <cstdint>
 #include <queue>
+#include <vector>
+#include <functional>
 
 #include "game_state.h"
 #include "node.h"
 #include "time_manager.h"
+#include "tracer.h"
+#include "sharded_counter.h"
+#include "config.h"
+
+class DistributedMaster;
+class SearchScheduler;
+
+// The statistics of one root child. It is exchanged between the
+// distributed master and workers.
+struct RootStat {
+    int vertex;
+    int visits;
+    int black_wins;
+};
+
+// The parameters which may differ between the searches of one process,
+// like the two sides of a match. They default to the cfg_ values.
+struct SearchParameters {
+    int threads{cfg_search_threads};
+    int playouts{cfg_playouts};
+    float c_uct{cfg_c_uct};
+    float fpu_value{cfg_fpu_value};
+    int static_eval{cfg_static_eval};
+    int static_margin{cfg_static_margin};
+    int root_policy{cfg_root_policy};
+};
 
 class Search {
 public:
-    Search(GameState &state);
+    // The search runs on its own thread pool, or on the shared pool
+    // of the scheduler if it is given.
+    Search(GameState &state, SearchParameters parameters=SearchParameters{},
+               SearchScheduler *scheduler=nullptr);
     ~Search();
 
     int think();
-    void time_setting(int main_time);
+    void time_setting(int main_time, int byo_time=0,
+                          int byo_stones=0, int byo_periods=0);
+    void time_left(int color, int time, int stones);
+
+    // Search the root state with a fixed budget and return the
+    // statistics of the root children. The search also stops early
+    // once interrupt returns true.
+    std::vector<RootStat> subsearch(int max_playouts, int thinking_centis,
+                                        std::function<bool()> interrupt=nullptr);
+
+    // The playouts of the last search.
+    int get_playouts() const;
+
+    // Drop the tree, so that the next search does not reuse it.
+    void release_tree();
 
 private:
+    friend class SearchScheduler;
+
     struct Monitor {
         std::mutex mutex;
         std::condition_variable cv;
 
         void wait() {
+            TraceScope scope("wait");
             std::unique_lock<std::mutex> lock(mutex);
             cv.wait(lock);
         }
+        template<typename Predicate>
+        void wait(Predicate pred) {
+            TraceScope scope("wait");
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, pred);
+        }
         void notify(bool all) {
+            {
+                // Synchronize with the waiting threads so that the
+                // notification can not be lost.
+                std::lock_guard<std::mutex> lock(mutex);
+            }
             if (all) {
                 cv.notify_all();
             } else {
@@ -38,22 +98,78 @@ private:
         }
     };
 
+    // Restart the generator of the calling thread with the stream
+    // after the search threads. The root expansion and the halving
+    // draw from it, so the deterministic search does not depend on
+    // the order in which the threads took their free streams.
+    void seed_controller();
+
     void prepare_root_node();
     void release_node(Node *n);
-    void release_tree();
 
     bool advance_to_new_rootstate();
     void init_pool();
-    void do_one_playout();
-    bool playout_recursive(GameState &curr_state, Node *node, int &eval);
+    void do_one_playout(Node *root, int thread_idx);
+
+    // Run one playout from the root through the given child.
+    void do_forced_playout(Node *root, Node *child, int thread_idx);
+
+    // Run the sequential halving over the Gumbel sampled moves of the
+    // root and return the chosen move. The search threads run the
+    // visits of each candidate. The playouts below the candidates are
+    // the normal tree search.
+    int run_sequential_halving(int max_playouts, int color);
+
+    // Run up to count playouts on the thread of the scheduler.
+    void run_batch(int thread_idx, int count);
+
+    // Start the search threads and wait until the playouts are
+    // enough or should_stop() is true.
+    // The weight is the share of the scheduler threads.
+    void run_search(int max_playouts, std::function<bool()> should_stop,
+                        double weight=1.0);
+
+    // Add the statistics of the workers to the root children, or take
+    // them back with the sign -1.
+    void merge_stats(Node *root, const std::vector<RootStat> &stats, int sign=1);
+    bool playout_recursive(GameState &curr_state, Node *node,
+                               int &eval, int virtual_loss, int thread_idx);
+
+    // The stop condition of think(). It stops early if the second move
+    // can not catch the best move, and extends the time once if the
+    // best move is unstable.
+    bool should_stop_search(int color, int max_playouts);
+
+    int get_initial_virtual_loss() const;
+    void adapt_virtual_loss(double collision_rate);
+
+    // Merge the upper tree statistics of the root parallel trees. Every
+    // tree sees the visits of the others as shared statistics.
+    void share_trees();
+    void share_nodes(std::vector<Node *> &nodes, int depth);
 
     void dump_analysis();
 
     GameState &m_root_state;
+    SearchParameters m_parameters;
     GameState m_last_state;
-    std::unique_ptr<Node> m_root_node{nullptr};
 
-    std::atomic<int> m_playouts;
+    // One root per independent tree. The first tree is the main tree
+    // which holds the merged statistics at decision time.
+    std::vector<std::unique_ptr<Node>> m_root_nodes;
+
+    // The counters are sharded by the search threads.
+    ShardedCounter m_playouts;
+    int m_max_playouts{0};
+
+    // The root child which every playout goes through, or nullptr. The
+    // sequential halving sets it.
+    std::atomic<Node *> m_forced_child{nullptr};
+
+    // The number of playouts which reach a leaf already being evaluated
+    // by other threads.
+    ShardedCounter m_collisions;
+    std::atomic<int> m_virtual_loss{0};
 
     std::mutex m_queue_mutex;
     std::queue<Node *> m_garbage_nodes;
@@ -66,7 +182,18 @@ private:
     std::atomic<bool> m_pool_running;
     std::vector<std::thread> m_pool;
 
+    // The first random stream of the search threads.
+    std::uint64_t m_stream_block{0};
+
     TimeManager m_time_manager;
+
+    int m_best_move;
+    int m_best_changed_centis;
+    int m_next_check_centis;
+
+    std::unique_ptr<DistributedMaster> m_master{nullptr};
+
+    SearchScheduler *m_scheduler{nullptr};
 };
 
 #endif
@@ -0,0 +1,125 @@
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "server.h"
+#include "gtp.h"
+#include "game_state.h"
+#include "search.h"
+#include "scheduler.h"
+#include "config.h"
+
+static std::mutex output_mutex;
+
+class Session {
+public:
+    Session(std::string id, SearchScheduler *scheduler) : m_id(id) {
+        m_game.clear_board(Board::BOARD_SIZE, 0.f, m_settings.hollow_pos);
+        m_search = std::make_unique<Search>(m_game, SearchParameters{}, scheduler);
+        m_search->time_setting(m_settings.main_time, m_settings.byo_time,
+                                   m_settings.byo_stones, m_settings.byo_periods);
+        m_thread = std::thread(&Session::loop, this);
+    }
+
+    ~Session() {
+        push(std::string{});
+        m_thread.join();
+    }
+
+    // Queue the command. The empty command stops the session.
+    void push(std::string command) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_commands.emplace(command);
+        }
+        m_cv.notify_one();
+    }
+
+    bool is_finished() const {
+        return m_finished.load();
+    }
+
+private:
+    void loop() {
+        while (true) {
+            std::string command;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this]() { return !m_commands.empty(); });
+                command = m_commands.front();
+                m_commands.pop();
+            }
+            if (command.empty()) {
+                break;
+            }
+
+            bool quit = false;
+            auto response = gtp_execute(&m_game, m_search.get(), m_settings,
+                                            command, quit);
+            if (!response.empty()) {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << m_id << ' ' << response << std::flush;
+            }
+            if (quit) {
+                break;
+            }
+        }
+        m_finished.store(true);
+    }
+
+    std::string m_id;
+    GtpSettings m_settings;
+    GameState m_game;
+    std::unique_ptr<Search> m_search;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::queue<std::string> m_commands;
+    std::atomic<bool> m_finished{false};
+
+    std::thread m_thread;
+};
+
+void server_loop() {
+    SearchScheduler scheduler(cfg_search_threads);
+    std::map<std::string, std::unique_ptr<Session>> sessions;
+
+    std::string inputs;
+    while (std::getline(std::cin, inputs)) {
+        // Close the sessions which quit.
+        for (auto ite = std::begin(sessions); ite != std::end(sessions);) {
+            if (ite->second->is_finished()) {
+                ite = sessions.erase(ite);
+            } else {
+                ++ite;
+            }
+        }
+
+        std::istringstream ss{inputs};
+        std::string id;
+        if (!(ss >> id)) {
+            continue;
+        }
+        std::string command;
+        std::getline(ss, command);
+        if (command.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        auto &session = sessions[id];
+        if (!session || session->is_finished()) {
+            session = std::make_unique<Session>(id, &scheduler);
+        }
+        session->push(command);
+    }
+
+    // Finish the queued commands of all sessions.
+    sessions.clear();
+}
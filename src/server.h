@@ -0,0 +1,11 @@
+#ifndef SERVER_H_INCLUDE
+#define SERVER_H_INCLUDE
+
+// Serve many games over the multiplexed GTP of stdin and stdout. Every
+// line is "<session> [id] <command>" and every response starts with
+// its session. A session is created by its first command and closed by
+// quit. Each session has its own GameState, tree and time settings,
+// and all sessions share one SearchScheduler.
+void server_loop();
+
+#endif
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sgf.h"
+#include "config.h"
+
+SgfReader::SgfReader(std::string filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            // The games are read from the front to the back.
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            m_size = st.st_size;
+            m_begin = static_cast<const char *>(addr);
+            m_end = m_begin + m_size;
+            m_pos = m_begin;
+        }
+    }
+    close(fd);
+}
+
+SgfReader::~SgfReader() {
+    if (m_begin) {
+        munmap(const_cast<char *>(m_begin), m_size);
+    }
+}
+
+bool SgfReader::is_open() const {
+    return m_begin != nullptr;
+}
+
+void SgfReader::skip_spaces() {
+    while (m_pos < m_end && std::isspace((unsigned char)*m_pos)) {
+        ++m_pos;
+    }
+}
+
+bool SgfReader::read_value(Value &value) {
+    skip_spaces();
+    if (m_pos >= m_end || *m_pos != '[') {
+        return false;
+    }
+    ++m_pos;
+    value.data = m_pos;
+    while (m_pos < m_end && *m_pos != ']') {
+        if (*m_pos == '\\') {
+            ++m_pos;
+        }
+        ++m_pos;
+    }
+    value.size = std::min(m_pos, m_end) - value.data;
+    if (m_pos < m_end) {
+        ++m_pos;
+    }
+    return true;
+}
+
+// Parse the point like "cd" into the column and the row from the top.
+// Return false for the pass.
+static bool parse_point(const char *data, std::size_t size, int &x, int &y) {
+    if (size != 2) {
+        return false;
+    }
+    x = data[0] - 'a';
+    y = data[1] - 'a';
+    return true;
+}
+
+// Convert the parsed point to the board coordinate. The first row of
+// SGF is the top one. Return false if it is off the board.
+static bool convert_point(int board_size, int &x, int &y) {
+    y = board_size - 1 - y;
+    return x >= 0 && x < board_size && y >= 0 && y < board_size;
+}
+
+void SgfReader::read_node(SgfGame &game) {
+    char ident[8];
+
+    while (true) {
+        skip_spaces();
+        if (m_pos >= m_end || !std::isupper((unsigned char)*m_pos)) {
+            return;
+        }
+        std::size_t len = 0;
+        while (m_pos < m_end && std::isupper((unsigned char)*m_pos)) {
+            if (len < sizeof(ident) - 1) {
+                ident[len++] = *m_pos;
+            }
+            ++m_pos;
+        }
+        ident[len] = '\0';
+
+        Value value;
+        while (read_value(value)) {
+            int x, y;
+            if (!std::strcmp(ident, "SZ")) {
+                game.board_size = std::atoi(std::string(value.data, value.size).c_str());
+            } else if (!std::strcmp(ident, "KM")) {
+                game.komi = std::atof(std::string(value.data, value.size).c_str());
+            } else if (!std::strcmp(ident, "HO")) {
+                game.has_hollow = true;
+                if (parse_point(value.data, value.size, x, y)) {
+                    game.hollow_pos.push_back({x, y});
+                }
+            } else if (!std::strcmp(ident, "B") || !std::strcmp(ident, "W")) {
+                const int color = ident[0] == 'B' ? Board::BLACK : Board::WHITE;
+                if (!parse_point(value.data, value.size, x, y)) {
+                    x = y = -1;
+                }
+                game.moves.emplace_back(SgfMove{color, x, y});
+            }
+        }
+    }
+}
+
+void SgfReader::skip_tree() {
+    int depth = 0;
+    Value value;
+    while (m_pos < m_end) {
+        if (*m_pos == '[') {
+            read_value(value);
+            continue;
+        }
+        if (*m_pos == '(') {
+            ++depth;
+        } else if (*m_pos == ')') {
+            if (--depth == 0) {
+                ++m_pos;
+                return;
+            }
+        }
+        ++m_pos;
+    }
+}
+
+void SgfReader::read_tree(SgfGame &game, bool main_line) {
+    // Read the sequence of the tree after the '('.
+    ++m_pos;
+    bool first_child = true;
+    while (true) {
+        skip_spaces();
+        if (m_pos >= m_end) {
+            return;
+        }
+        const char c = *m_pos;
+        if (c == ';') {
+            ++m_pos;
+            read_node(game);
+        } else if (c == '(') {
+            // Follow the first variation only.
+            if (main_line && first_child) {
+                first_child = false;
+                read_tree(game, true);
+            } else {
+                skip_tree();
+            }
+        } else if (c == ')') {
+            ++m_pos;
+            return;
+        } else {
+            ++m_pos;
+        }
+    }
+}
+
+bool SgfReader::next_game(SgfGame &game) {
+    game = SgfGame{};
+    while (m_pos < m_end && *m_pos != '(') {
+        ++m_pos;
+    }
+    if (m_pos >= m_end) {
+        return false;
+    }
+    read_tree(game, true);
+
+    // The SZ may follow the points in the root node, so the points are
+    // converted after the whole game is read.
+    std::vector<std::array<int, 2>> hollow_pos;
+    for (auto pos : game.hollow_pos) {
+        if (convert_point(game.board_size, pos[0], pos[1])) {
+            hollow_pos.push_back(pos);
+        }
+    }
+    game.hollow_pos = hollow_pos;
+    for (auto &move : game.moves) {
+        if (move.x >= 0 && !convert_point(game.board_size, move.x, move.y)) {
+            move.x = move.y = -1;
+        }
+    }
+    return true;
+}
+
+bool sgf_to_game_state(const SgfGame &game, GameState &state, int max_moves) {
+    const int board_size = std::min(game.board_size, (int)Board::BOARD_SIZE);
+    if (game.has_hollow) {
+        state.clear_board(board_size, game.komi, game.hollow_pos);
+    } else {
+        state.clear_board(board_size, game.komi);
+    }
+
+    int moves = 0;
+    for (const auto &move : game.moves) {
+        if (max_moves >= 0 && moves >= max_moves) {
+            break;
+        }
+        if (move.x < 0) {
+            // NoGo has no pass. Keep the turn order of the record.
+            state.set_to_move(!move.color);
+            continue;
+        }
+        if (!state.play_move(state.get_vertex(move.x, move.y), move.color)) {
+            return false;
+        }
+        ++moves;
+    }
+    return true;
+}
+
+std::string game_state_to_sgf(const GameState &state) {
+    const int board_size = state.get_board_size();
+    auto to_point = [board_size](int x, int y) {
+        std::string point;
+        point += (char)('a' + x);
+        point += (char)('a' + board_size - 1 - y);
+        return point;
+    };
+
+    std::ostringstream out;
+    out << "(;GM[1]FF[4]SZ[" << board_size << "]KM[" << state.get_komi() << "]";
+
+    out << "HO";
+    bool has_hollow = false;
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            if (state.get_state(state.get_vertex(x, y)) == Board::INVLD) {
+                out << "[" << to_point(x, y) << "]";
+                has_hollow = true;
+            }
+        }
+    }
+    if (!has_hollow) {
+        out << "[]";
+    }
+
+    // The stones are never removed in NoGo, so the color of a move is
+    // the color of its stone.
+    GameState fork_state = state;
+    std::vector<int> moves;
+    while (fork_state.get_movenum() > 0) {
+        moves.emplace_back(fork_state.get_last_move());
+        fork_state.undo_move();
+    }
+    for (auto ite = moves.rbegin(); ite != moves.rend(); ++ite) {
+        const int vtx = *ite;
+        const int color = state.get_state(vtx);
+        out << ";" << (color == Board::BLACK ? "B" : "W")
+                << "[" << to_point(state.get_x(vtx), state.get_y(vtx)) << "]";
+    }
+    out << ")";
+    return out.str();
+}
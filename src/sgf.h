@@ -0,0 +1,72 @@
+#ifndef SGF_H_INCLUDE
+#define SGF_H_INCLUDE
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "game_state.h"
+
+// The hollow points are stored in the custom property HO, like
+// HO[be][ce]. HO[] means no hollow point. Without HO the default
+// layout is used.
+struct SgfMove {
+    int color;
+    int x;
+    int y;
+};
+
+struct SgfGame {
+    int board_size{Board::BOARD_SIZE};
+    float komi{0.f};
+    bool has_hollow{false};
+    std::vector<std::array<int, 2>> hollow_pos;
+
+    // The x and y of the pass are -1.
+    std::vector<SgfMove> moves;
+};
+
+// Read the games of a file one by one. The file is memory mapped and
+// parsed in place, so a large collection is never loaded into memory
+// as a whole. Only the main line of every game is read.
+class SgfReader {
+public:
+    explicit SgfReader(std::string filename);
+    ~SgfReader();
+
+    SgfReader(const SgfReader &) = delete;
+    SgfReader &operator=(const SgfReader &) = delete;
+
+    bool is_open() const;
+
+    // Parse the next game into the game. Return false at the end of
+    // the file.
+    bool next_game(SgfGame &game);
+
+private:
+    // A property value in the mapped file.
+    struct Value {
+        const char *data;
+        std::size_t size;
+    };
+
+    void skip_spaces();
+    bool read_value(Value &value);
+    void read_node(SgfGame &game);
+    void read_tree(SgfGame &game, bool main_line);
+    void skip_tree();
+
+    const char *m_begin{nullptr};
+    const char *m_end{nullptr};
+    const char *m_pos{nullptr};
+    std::size_t m_size{0};
+};
+
+// Set up the state from the game. Play at most max_moves moves if it
+// is not negative. Return false if a move is illegal.
+bool sgf_to_game_state(const SgfGame &game, GameState &state, int max_moves=-1);
+
+std::string game_state_to_sgf(const GameState &state);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SHARDED_COUNTER_H_INCLUDE
+#define SHARDED_COUNTER_H_INCLUDE
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#define CACHE_LINE_SIZE (64)
+
+// A counter split into per-thread shards. Every shard is on its own
+// cache line and is written only by its owner thread, so adding is a
+// relaxed load and store without the locked instruction. The total is
+// summed on demand.
+class ShardedCounter {
+public:
+    void resize(int num_shards) {
+        m_num_shards = std::max(num_shards, 1);
+        m_shards.reset(new Shard[m_num_shards]);
+        reset();
+    }
+
+    void add(int shard, int val) {
+        auto &value = m_shards[shard].value;
+        value.store(value.load(std::memory_order_relaxed) + val,
+                        std::memory_order_relaxed);
+    }
+
+    int load() const {
+        int sum = 0;
+        for (int i = 0; i < m_num_shards; ++i) {
+            sum += m_shards[i].value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    // Should not race with add().
+    void reset() {
+        for (int i = 0; i < m_num_shards; ++i) {
+            m_shards[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Shard {
+        std::atomic<int> value;
+        char padding[CACHE_LINE_SIZE - sizeof(std::atomic<int>)];
+    };
+
+    std::unique_ptr<Shard[]> m_shards{nullptr};
+    int m_num_shards{0};
+};
+
+#endif
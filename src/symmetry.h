@@ -0,0 +1,23 @@
+#ifndef SYMMETRY_H_INCLUDE
+#define SYMMETRY_H_INCLUDE
+
+#include <utility>
+
+// The rotations and reflections of the square board.
+#define NUM_SYMMETRIES (8)
+
+// Transform the coordinate by the symmetry. The bit 4 transposes the
+// board, the bit 1 mirrors x and the bit 2 mirrors y.
+inline void transform_symmetry(int symmetry, int board_size, int &x, int &y) {
+    if (symmetry & 4) {
+        std::swap(x, y);
+    }
+    if (symmetry & 1) {
+        x = board_size - 1 - x;
+    }
+    if (symmetry & 2) {
+        y = board_size - 1 - y;
+    }
+}
+
+#endif
@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "time_manager.h"
+#include "config.h"
 
 Time::Time() {
     m_time = std::chrono::steady_clock::now();
@@ -19,27 +22,125 @@ TimeManager::TimeManager() {
 }
 
 void TimeManager::reset() {
-    m_remining_times[0] = m_main_time;
-    m_remining_times[1] = m_main_time;
+    for (int color = 0; color < 2; ++color) {
+        m_remining_times[color] = m_main_time;
+        m_thinking_times[color] = 0;
+        m_planned_times[color] = 0;
+        m_saved_times[color] = 0;
+        m_extended[color] = false;
+        m_max_thinking_times[color] = 0;
+
+        m_in_byo[color] = (m_main_time <= 0 && (is_canadian() || is_japanese()));
+        m_byo_times_left[color] = m_byo_time;
+        m_byo_stones_left[color] = m_byo_stones;
+        m_byo_periods_left[color] = m_byo_periods;
+        m_expect_sync[color] = false;
+    }
 }
 
-void TimeManager::time_setting(int main_time, int lag_buffer) {
+void TimeManager::time_setting(int main_time, int byo_time,
+                                   int byo_stones, int byo_periods, int lag_buffer) {
     m_lag_buffer = 100 * lag_buffer; // second -> centisecond
     m_main_time =  100 * main_time; // second -> centisecond
+    m_byo_time = 100 * byo_time; // second -> centisecond
+    m_byo_stones = byo_stones;
+    m_byo_periods = byo_periods;
     reset();
 }
 
+bool TimeManager::is_canadian() const {
+    return m_byo_time > 0 && m_byo_stones > 0;
+}
+
+bool TimeManager::is_japanese() const {
+    return m_byo_time > 0 && m_byo_periods > 0 && !is_canadian();
+}
+
+void TimeManager::time_left(int color, int time, int stones) {
+    const int reported_centis = 100 * time;
+    int expected_centis = -1;
+
+    if (stones == 0) {
+        if (!m_in_byo[color]) {
+            expected_centis = m_remining_times[color];
+        }
+        m_in_byo[color] = false;
+        m_remining_times[color] = reported_centis;
+    } else {
+        if (m_in_byo[color] && is_canadian()) {
+            expected_centis = m_byo_times_left[color];
+        }
+        m_in_byo[color] = true;
+        m_remining_times[color] = 0;
+        if (is_japanese()) {
+            m_byo_periods_left[color] = stones;
+        } else {
+            m_byo_times_left[color] = reported_centis;
+            m_byo_stones_left[color] = stones;
+        }
+    }
+
+    if (m_expect_sync[color] && expected_centis >= 0) {
+        // Our own clock misses the time spent on the network and the
+        // GUI. Keep the buffer about twice the measured lag.
+        const int lag_centis = std::max(expected_centis - reported_centis, 0);
+        m_lag_buffer = std::max((3 * m_lag_buffer + 2 * lag_centis + 5) / 4, 5);
+    }
+    m_expect_sync[color] = false;
+}
+
 void TimeManager::clock(int color, GameState &state) {
     m_times[color] = Time();
     int board_size = state.get_board_size();
     int remining_centis = m_remining_times[color];
+    int thinking_centis = 0;
+    int available_centis = 0;
+
+    if (!m_in_byo[color]) {
+        // The saved time is a part of the remaining time. It is kept
+        // out of the normal budget so that it is only spent once.
+        m_saved_times[color] = std::min(m_saved_times[color], remining_centis);
+
+        int c_max_ply = 0.5 * (board_size * board_size);
+        int c_base_ply = 0.25 * (board_size * board_size);
+        thinking_centis =
+            (remining_centis - m_saved_times[color]) / (
+                c_base_ply + std::max(c_max_ply - state.get_movenum(), 0));
+
+        // Spend a part of the saved time on this move.
+        const int saved_bonus = m_saved_times[color] / 4;
+        thinking_centis += saved_bonus;
+        m_saved_times[color] -= saved_bonus;
+
+        available_centis = remining_centis;
+        m_max_thinking_times[color] = remining_centis / 4;
+        if (is_canadian()) {
+            thinking_centis = std::max(thinking_centis, m_byo_time / m_byo_stones);
+            available_centis += m_byo_times_left[color];
+        } else if (is_japanese()) {
+            // The first period is free for every move.
+            thinking_centis = std::max(thinking_centis, m_byo_time);
+            available_centis += m_byo_time;
+        } else {
+            thinking_centis = std::min(thinking_centis, remining_centis / 2);
+        }
+    } else if (is_canadian()) {
+        available_centis = m_byo_times_left[color];
+        thinking_centis = available_centis / std::max(m_byo_stones_left[color], 1);
+        m_max_thinking_times[color] = available_centis;
+    } else {
+        available_centis = m_byo_time;
+        thinking_centis = available_centis;
+        m_max_thinking_times[color] = available_centis;
+    }
+
+    const int safe_centis = std::max(available_centis - m_lag_buffer, 0);
+    thinking_centis = std::max(std::min(thinking_centis, safe_centis), 0);
+    m_max_thinking_times[color] = std::min(m_max_thinking_times[color], safe_centis);
 
-    int c_max_ply = 0.5 * (board_size * board_size);
-    int c_base_ply = 0.25 * (board_size * board_size);
-    int thinking_centis =
-        remining_centis / (
-            c_base_ply + std::max(c_max_ply - state.get_movenum(), 0));
     m_thinking_times[color] = thinking_centis;
+    m_planned_times[color] = thinking_centis;
+    m_extended[color] = false;
 }
 
 float TimeManager::get_thinking_time(int color) const {
@@ -63,9 +164,80 @@ void TimeManager::stop(int color) {
     Time start = m_times[color];
     Time end;
     int elapsed_centis = Time::timediff_centis(start, end);
-    m_remining_times[color] -= elapsed_centis;
+
+    if (!m_in_byo[color]) {
+        m_remining_times[color] -= elapsed_centis;
+        if (m_remining_times[color] < 0 && (is_canadian() || is_japanese())) {
+            const int overflow_centis = -m_remining_times[color];
+            m_remining_times[color] = 0;
+            m_in_byo[color] = true;
+            charge_byo(color, overflow_centis);
+        }
+    } else {
+        charge_byo(color, elapsed_centis);
+    }
+
+    if (cfg_adaptive_time && !m_in_byo[color]) {
+        m_saved_times[color] += std::max(m_planned_times[color] - elapsed_centis, 0);
+    } else {
+        m_saved_times[color] = 0;
+    }
+    m_expect_sync[color] = true;
+}
+
+void TimeManager::charge_byo(int color, int used_centis) {
+    if (is_canadian()) {
+        m_byo_times_left[color] = std::max(m_byo_times_left[color] - used_centis, 0);
+        if (--m_byo_stones_left[color] <= 0) {
+            // Start a new period.
+            m_byo_times_left[color] = m_byo_time;
+            m_byo_stones_left[color] = m_byo_stones;
+        }
+    } else if (is_japanese()) {
+        if (used_centis > m_byo_time) {
+            m_byo_periods_left[color] = std::max(m_byo_periods_left[color] - 1, 0);
+        }
+    }
+}
+
+int TimeManager::get_elapsed_centis(int color) const {
+    return Time::timediff_centis(m_times[color], Time());
+}
+
+int TimeManager::get_thinking_centis(int color) const {
+    return m_thinking_times[color];
+}
+
+bool TimeManager::extend_thinking_time(int color) {
+    if (m_extended[color]) {
+        return false;
+    }
+    const int max_thinking_centis = m_max_thinking_times[color];
+    const int extended_centis = std::min(
+        m_thinking_times[color] + m_planned_times[color] / 2, max_thinking_centis);
+
+    if (extended_centis <= m_thinking_times[color]) {
+        return false;
+    }
+    m_thinking_times[color] = extended_centis;
+    m_extended[color] = true;
+    return true;
+}
+
+float TimeManager::get_saved_time(int color) const {
+    return (float)m_saved_times[color]/100.f;
 }
 
 float TimeManager::get_time_left(int color) const {
+    if (m_in_byo[color]) {
+        if (is_canadian()) {
+            return (float)m_byo_times_left[color]/100.f;
+        }
+        return (float)m_byo_time/100.f;
+    }
     return (float)m_remining_times[color]/100.f;
 }
+
+float TimeManager::get_lag_buffer() const {
+    return (float)m_lag_buffer/100.f;
+}
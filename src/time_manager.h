@@ -22,7 +22,16 @@ public:
     TimeManager();
 
     void reset();
-    void time_setting(int main_time, int lag_buffer=1);
+
+    // The byo-yomi is Canadian if byo_stones is positive, Japanese if
+    // byo_periods is positive, otherwise it is absolute time.
+    void time_setting(int main_time, int byo_time=0,
+                          int byo_stones=0, int byo_periods=0, int lag_buffer=1);
+
+    // Resync the clock with the referee. The stones is zero in main
+    // time, otherwise it is the stones (Canadian) or periods (Japanese)
+    // left.
+    void time_left(int color, int time, int stones);
 
     void clock(int color, GameState &state);
     float get_thinking_time(int color) const;
@@ -31,12 +40,50 @@ public:
 
     float get_time_left(int color) const;
 
+    int get_elapsed_centis(int color) const;
+    int get_thinking_centis(int color) const;
+
+    // Add the half of the planned thinking time, only once per move.
+    // Return false if there is no time to extend.
+    bool extend_thinking_time(int color);
+
+    // The time which is planned but not used by the early stopped moves.
+    // It is kept in the remaining time and only grows with the adaptive
+    // time.
+    float get_saved_time(int color) const;
+
+    float get_lag_buffer() const;
+
 private:
+    bool is_canadian() const;
+    bool is_japanese() const;
+
+    // Charge the used time in byo-yomi.
+    void charge_byo(int color, int used_centis);
+
     std::array<int, 2> m_remining_times;
     std::array<Time, 2> m_times;
     std::array<int, 2> m_thinking_times;
+    std::array<int, 2> m_planned_times;
+    std::array<int, 2> m_saved_times;
+    std::array<bool, 2> m_extended;
+    std::array<int, 2> m_max_thinking_times;
+
+    std::array<bool, 2> m_in_byo;
+    std::array<int, 2> m_byo_times_left;
+    std::array<int, 2> m_byo_stones_left;
+    std::array<int, 2> m_byo_periods_left;
+
+    // True if the clock is charged by ourself and the next time_left
+    // can measure the lag.
+    std::array<bool, 2> m_expect_sync;
 
     int m_main_time;
+    int m_byo_time;
+    int m_byo_stones;
+    int m_byo_periods;
+
+    // The lag buffer adapts to the measured round-trip.
     int m_lag_buffer;
 };
 
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+#include "tracer.h"
+
+static std::uint64_t get_nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Tracer &Tracer::get() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() {
+    m_start_nanos = get_nanos();
+}
+
+Tracer::ThreadBuffer &Tracer::get_thread_buffer() {
+    static thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_buffers.emplace_back(std::make_unique<ThreadBuffer>());
+        buffer = m_buffers.back().get();
+        buffer->tid = m_buffers.size();
+        buffer->name = "thread " + std::to_string(buffer->tid);
+    }
+    return *buffer;
+}
+
+void Tracer::set_thread_name(std::string name) {
+    auto &buffer = get_thread_buffer();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer.name = name;
+}
+
+void Tracer::push(const char *name, char phase) {
+    auto &buffer = get_thread_buffer();
+    const auto head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % TRACE_BUFFER_SIZE] = Event{name, get_nanos(), phase};
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::begin(const char *name) {
+    push(name, 'B');
+}
+
+void Tracer::end(const char *name) {
+    push(name, 'E');
+}
+
+void Tracer::dump() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto filename = cfg_trace_file + "_" + std::to_string(++m_dumps) + ".json";
+    std::ofstream file{filename};
+    if (!file.is_open()) {
+        fprintf(cfg_search_file, "Fail to open the trace file %s.\n", filename.c_str());
+        return;
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\": [\n";
+
+    bool first = true;
+    for (auto &buffer : m_buffers) {
+        file << (first ? "" : ",\n")
+                 << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+                 << "\"tid\": " << buffer->tid << ", "
+                 << "\"args\": {\"name\": \"" << buffer->name << "\"}}";
+        first = false;
+
+        // The events older than one buffer are lost.
+        const auto head = buffer->head.load(std::memory_order_acquire);
+        auto tail = std::max(buffer->tail, head - std::min<std::uint64_t>(head, TRACE_BUFFER_SIZE));
+        for (; tail < head; ++tail) {
+            const auto &event = buffer->events[tail % TRACE_BUFFER_SIZE];
+            file << ",\n{\"name\": \"" << event.name << "\", "
+                     << "\"ph\": \"" << event.phase << "\", "
+                     << "\"ts\": " << (event.nanos - m_start_nanos) / 1000.0 << ", "
+                     << "\"pid\": 0, \"tid\": " << buffer->tid << "}";
+        }
+        buffer->tail = head;
+    }
+    file << "\n]}\n";
+
+    fprintf(cfg_search_file, "Dump the trace to %s.\n", filename.c_str());
+}
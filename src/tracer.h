@@ -0,0 +1,84 @@
+#ifndef TRACER_H_INCLUDE
+#define TRACER_H_INCLUDE
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "config.h"
+
+// The events per thread. The oldest events are overwritten when the
+// buffer is full.
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+// Record the begin and end events of the search threads and dump them
+// in the Chrome trace format. It is enabled by --trace <prefix>.
+class Tracer {
+public:
+    static Tracer &get();
+
+    static bool enabled() {
+        return !cfg_trace_file.empty();
+    }
+
+    // Name the current thread in the trace.
+    void set_thread_name(std::string name);
+
+    // The name should be a string literal.
+    void begin(const char *name);
+    void end(const char *name);
+
+    // Write the events since the last dump to <prefix>_<n>.json.
+    void dump();
+
+private:
+    struct Event {
+        const char *name;
+        std::uint64_t nanos;
+        char phase;
+    };
+
+    // A single producer ring buffer. The owner thread writes the events
+    // and publishes the head. The dump reads up to the head.
+    struct ThreadBuffer {
+        int tid;
+        std::string name;
+        std::atomic<std::uint64_t> head{0};
+        std::uint64_t tail{0};
+        Event events[TRACE_BUFFER_SIZE];
+    };
+
+    Tracer();
+
+    ThreadBuffer &get_thread_buffer();
+    void push(const char *name, char phase);
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    std::uint64_t m_start_nanos;
+    int m_dumps{0};
+};
+
+// Trace a scope if the tracer is enabled.
+class TraceScope {
+public:
+    TraceScope(const char *name) : m_name(name) {
+        if (Tracer::enabled()) {
+            Tracer::get().begin(m_name);
+        }
+    }
+
+    ~TraceScope() {
+        if (Tracer::enabled()) {
+            Tracer::get().end(m_name);
+        }
+    }
+
+private:
+    const char *m_name;
+};
+
+#endif
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "training.h"
+#include "search.h"
+#include "random.h"
+#include "symmetry.h"
+#include "config.h"
+
+// The records per chunk.
+#define TRAINING_CHUNK_RECORDS (4096)
+
+#define TRAINING_VERSION (1)
+
+#define TRAINING_FLAG_ZLIB (1)
+
+// The first moves of a self-play game are drawn by the root visits, so
+// the games differ.
+#define SELFPLAY_RANDOM_MOVES (8)
+
+// The stream of the opening moves, apart from the searches which
+// reseed the calling thread.
+#define SELFPLAY_STREAM ((1 << 15) + 1)
+
+#pragma pack(push, 1)
+struct ChunkHeader {
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t flags;
+    std::uint32_t num_records;
+    std::uint32_t payload_size;
+};
+#pragma pack(pop)
+
+static int get_point(const TrainingRecord &record, int idx) {
+    return (record.board[idx / 4] >> (2 * (idx % 4))) & 3;
+}
+
+static void set_point(TrainingRecord &record, int idx, int state) {
+    record.board[idx / 4] &= ~(3 << (2 * (idx % 4)));
+    record.board[idx / 4] |= state << (2 * (idx % 4));
+}
+
+void encode_record(const GameState &state, TrainingRecord &record) {
+    std::memset(&record, 0, sizeof(record));
+
+    const int board_size = state.get_board_size();
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            set_point(record, state.get_index(x, y),
+                          state.get_state(state.get_vertex(x, y)));
+        }
+    }
+    record.tomove = state.get_tomove();
+}
+
+void decode_record(const TrainingRecord &record, GameState &state) {
+    const int board_size = Board::BOARD_SIZE;
+    std::vector<std::array<int, 2>> hollow_pos;
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            if (get_point(record, y * board_size + x) == Board::INVLD) {
+                hollow_pos.push_back({x, y});
+            }
+        }
+    }
+
+    state.clear_board(board_size, 0.f, hollow_pos);
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            const int point = get_point(record, y * board_size + x);
+            if (point == Board::BLACK || point == Board::WHITE) {
+                state.board.play_move_assume_legal(state.get_vertex(x, y), point);
+            }
+        }
+    }
+    state.set_to_move(record.tomove);
+}
+
+std::vector<int> get_layout_symmetries(const TrainingRecord &record) {
+    const int board_size = Board::BOARD_SIZE;
+    std::vector<int> symmetries;
+
+    for (int symmetry = 0; symmetry < NUM_SYMMETRIES; ++symmetry) {
+        bool same_layout = true;
+        for (int y = 0; y < board_size && same_layout; ++y) {
+            for (int x = 0; x < board_size && same_layout; ++x) {
+                int tx = x, ty = y;
+                transform_symmetry(symmetry, board_size, tx, ty);
+                same_layout =
+                    (get_point(record, y * board_size + x) == Board::INVLD) ==
+                        (get_point(record, ty * board_size + tx) == Board::INVLD);
+            }
+        }
+        if (same_layout) {
+            symmetries.emplace_back(symmetry);
+        }
+    }
+    return symmetries;
+}
+
+TrainingRecord transform_record(const TrainingRecord &record, int symmetry) {
+    const int board_size = Board::BOARD_SIZE;
+    TrainingRecord out = record;
+
+    for (int y = 0; y < board_size; ++y) {
+        for (int x = 0; x < board_size; ++x) {
+            int tx = x, ty = y;
+            transform_symmetry(symmetry, board_size, tx, ty);
+            const int idx = y * board_size + x;
+            const int tidx = ty * board_size + tx;
+
+            set_point(out, tidx, get_point(record, idx));
+            out.visits[tidx] = record.visits[idx];
+            if (record.move == idx) {
+                out.move = tidx;
+            }
+        }
+    }
+    return out;
+}
+
+TrainingWriter::~TrainingWriter() {
+    close();
+}
+
+bool TrainingWriter::open(std::string filename, bool compress) {
+#ifndef USE_ZLIB
+    if (compress) {
+        fprintf(stderr, "The zlib is not compiled in. Write the records uncompressed.\n");
+        compress = false;
+    }
+#endif
+    m_file = fopen(filename.c_str(), "ab");
+    if (!m_file) {
+        fprintf(stderr, "Fail to open the training data %s.\n", filename.c_str());
+        return false;
+    }
+    m_compress = compress;
+    m_running = true;
+    m_thread = std::thread([this]() { write_loop(); });
+    return true;
+}
+
+void TrainingWriter::add_game(std::vector<TrainingRecord> records) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_games.emplace_back(std::move(records));
+    }
+    m_cv.notify_one();
+}
+
+void TrainingWriter::close() {
+    if (!m_file) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void TrainingWriter::write_loop() {
+    std::vector<TrainingRecord> chunk;
+    chunk.reserve(TRAINING_CHUNK_RECORDS);
+
+    while (true) {
+        std::vector<TrainingRecord> game;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() {
+                return !m_running || !m_games.empty();
+            });
+            if (m_games.empty()) {
+                break;
+            }
+            game = std::move(m_games.front());
+            m_games.pop_front();
+        }
+
+        for (const auto &record : game) {
+            chunk.emplace_back(record);
+            if (chunk.size() == TRAINING_CHUNK_RECORDS) {
+                write_chunk(chunk);
+                chunk.clear();
+            }
+        }
+    }
+
+    if (!chunk.empty()) {
+        write_chunk(chunk);
+    }
+    if (!m_failed.load() && fflush(m_file) != 0) {
+        m_failed.store(true);
+        fprintf(stderr, "Fail to write the training data.\n");
+    }
+}
+
+bool TrainingWriter::failed() const {
+    return m_failed.load();
+}
+
+void TrainingWriter::write_chunk(const std::vector<TrainingRecord> &chunk) {
+    if (m_failed.load()) {
+        // Do not append the later chunks after a broken one.
+        return;
+    }
+
+    const auto data = reinterpret_cast<const unsigned char *>(chunk.data());
+    const size_t size = chunk.size() * sizeof(TrainingRecord);
+
+    ChunkHeader header{{'N', 'G', 'T', 'D'}, TRAINING_VERSION, 0,
+                           (std::uint32_t)chunk.size(), (std::uint32_t)size};
+    std::vector<unsigned char> payload(data, data + size);
+
+#ifdef USE_ZLIB
+    if (m_compress) {
+        uLongf compressed_size = compressBound(size);
+        payload.resize(compressed_size);
+        if (compress2(payload.data(), &compressed_size, data, size, Z_BEST_SPEED) == Z_OK) {
+            payload.resize(compressed_size);
+            header.flags |= TRAINING_FLAG_ZLIB;
+            header.payload_size = compressed_size;
+        } else {
+            payload.assign(data, data + size);
+        }
+    }
+#endif
+
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+            fwrite(payload.data(), 1, payload.size(), m_file) != payload.size()) {
+        m_failed.store(true);
+        fprintf(stderr, "Fail to write the training data.\n");
+    }
+}
+
+TrainingReader::~TrainingReader() {
+    if (m_file) {
+        fclose(m_file);
+    }
+}
+
+bool TrainingReader::open(std::string filename) {
+    m_file = fopen(filename.c_str(), "rb");
+    return m_file != nullptr;
+}
+
+bool TrainingReader::read_chunk() {
+    ChunkHeader header;
+    if (fread(&header, sizeof(header), 1, m_file) != 1 ||
+            std::memcmp(header.magic, "NGTD", 4) != 0 ||
+            header.version != TRAINING_VERSION) {
+        return false;
+    }
+
+    // Check the sizes before allocating, so that a broken header is
+    // only a broken chunk.
+    const size_t size = (size_t)header.num_records * sizeof(TrainingRecord);
+    if (header.num_records == 0 || header.num_records > TRAINING_CHUNK_RECORDS) {
+        return false;
+    }
+    if (header.flags & TRAINING_FLAG_ZLIB) {
+#ifdef USE_ZLIB
+        if (header.payload_size > compressBound(size)) {
+            return false;
+        }
+#else
+        fprintf(stderr, "The zlib is not compiled in. Can not read the compressed chunk.\n");
+        return false;
+#endif
+    } else if (header.payload_size != size) {
+        return false;
+    }
+
+    std::vector<unsigned char> payload(header.payload_size);
+    if (fread(payload.data(), 1, payload.size(), m_file) != payload.size()) {
+        return false;
+    }
+
+    m_chunk.resize(header.num_records);
+    m_index = 0;
+    auto data = reinterpret_cast<unsigned char *>(m_chunk.data());
+
+#ifdef USE_ZLIB
+    if (header.flags & TRAINING_FLAG_ZLIB) {
+        uLongf uncompressed_size = size;
+        return uncompress(data, &uncompressed_size,
+                              payload.data(), payload.size()) == Z_OK &&
+                   uncompressed_size == size;
+    }
+#endif
+    std::memcpy(data, payload.data(), size);
+    return true;
+}
+
+bool TrainingReader::next(TrainingRecord &record) {
+    while (m_index >= m_chunk.size()) {
+        if (!m_file || !read_chunk()) {
+            return false;
+        }
+    }
+    record = m_chunk[m_index++];
+    return true;
+}
+
+void run_selfplay(int games, std::string filename) {
+    TrainingWriter writer;
+    if (!writer.open(filename, cfg_selfplay_compress)) {
+        return;
+    }
+
+    // Keep the search logs of the games quiet.
+    FILE *null_file = fopen("/dev/null", "w");
+    FILE *search_file = cfg_search_file;
+    if (null_file && !cfg_dump_analysis) {
+        cfg_search_file = null_file;
+    }
+
+    PRNG rng(PRNG::get_stream_seed(SELFPLAY_STREAM));
+    long long total_records = 0;
+
+    for (int g = 0; g < games && !writer.failed(); ++g) {
+        GameState state;
+        state.clear_board(Board::BOARD_SIZE, 0.f);
+        Search search(state);
+        std::vector<TrainingRecord> records;
+
+        while (!state.is_gameover(state.get_tomove())) {
+            const int color = state.get_tomove();
+            auto stats = search.subsearch(cfg_playouts, std::numeric_limits<int>::max());
+
+            TrainingRecord record;
+            encode_record(state, record);
+
+            int total_visits = 0;
+            int best_vtx = Board::NULL_VERTEX;
+            int best_visits = -1;
+            for (const auto &stat : stats) {
+                const int idx = state.get_index(state.get_x(stat.vertex), state.get_y(stat.vertex));
+                record.visits[idx] = std::min(stat.visits, (int)std::numeric_limits<std::uint16_t>::max());
+                total_visits += stat.visits;
+                if (stat.visits > best_visits) {
+                    best_visits = stat.visits;
+                    best_vtx = stat.vertex;
+                }
+            }
+            if (best_vtx == Board::NULL_VERTEX) {
+                break;
+            }
+
+            int vtx = best_vtx;
+            if ((int)records.size() < SELFPLAY_RANDOM_MOVES && total_visits > 0) {
+                int pick = rng.randuint32(total_visits);
+                for (const auto &stat : stats) {
+                    pick -= stat.visits;
+                    if (pick < 0) {
+                        vtx = stat.vertex;
+                        break;
+                    }
+                }
+            }
+
+            record.move = state.get_index(state.get_x(vtx), state.get_y(vtx));
+            records.emplace_back(record);
+            state.play_move(vtx, color);
+        }
+
+        // The side which can not move loses.
+        const int loser = state.get_tomove();
+        for (auto &record : records) {
+            record.result = record.tomove == loser ? -1 : 1;
+        }
+        total_records += records.size();
+
+        fprintf(stderr, "Game %d: %zu moves, %s wins.\n", g + 1, records.size(),
+                    loser == Board::BLACK ? "white" : "black");
+        writer.add_game(std::move(records));
+    }
+    writer.close();
+
+    cfg_search_file = search_file;
+    if (null_file) {
+        fclose(null_file);
+    }
+    if (!writer.failed()) {
+        fprintf(stderr, "Write %lld records to %s.\n", total_records, filename.c_str());
+    }
+}
+
+void run_training_dump(std::string filename, bool augment) {
+    TrainingReader reader;
+    if (!reader.open(filename)) {
+        fprintf(stderr, "Fail to open the training data %s.\n", filename.c_str());
+        return;
+    }
+
+    const char state_map[4] = {'x', 'o', '.', '-'};
+    TrainingRecord record;
+    for (int n = 0; reader.next(record); ++n) {
+        std::vector<int> symmetries = {0};
+        if (augment) {
+            symmetries = get_layout_symmetries(record);
+        }
+        for (int symmetry : symmetries) {
+            const auto out = transform_record(record, symmetry);
+            std::ostringstream ss;
+            ss << "{\"record\": " << n
+                   << ", \"symmetry\": " << symmetry
+                   << ", \"tomove\": \"" << (out.tomove == Board::BLACK ? "b" : "w") << "\""
+                   << ", \"move\": " << (int)out.move
+                   << ", \"result\": " << (int)out.result
+                   << ", \"board\": \"";
+            for (int idx = 0; idx < Board::NUM_INTESECTIONS; ++idx) {
+                ss << state_map[get_point(out, idx)];
+            }
+            ss << "\", \"visits\": [";
+            bool first = true;
+            for (int idx = 0; idx < Board::NUM_INTESECTIONS; ++idx) {
+                if (out.visits[idx] > 0) {
+                    ss << (first ? "" : ", ") << "[" << idx << ", " << out.visits[idx] << "]";
+                    first = false;
+                }
+            }
+            ss << "]}";
+            std::cout << ss.str() << std::endl;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef TRAINING_H_INCLUDE
+#define TRAINING_H_INCLUDE
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "game_state.h"
+
+// The bytes of the board with four 2 bits points per byte.
+#define TRAINING_BOARD_BYTES ((Board::NUM_INTESECTIONS + 3) / 4)
+
+// One move of a self-play game. The board keeps the Board::vertex_t
+// of every point by index, so the hollow points are the INVLD ones.
+#pragma pack(push, 1)
+struct TrainingRecord {
+    std::uint8_t board[TRAINING_BOARD_BYTES];
+    std::uint8_t tomove;
+    std::uint8_t move;
+
+    // 1 if the side to move wins the game, otherwise -1.
+    std::int8_t result;
+
+    // The root visits of the moves by index.
+    std::uint16_t visits[Board::NUM_INTESECTIONS];
+};
+#pragma pack(pop)
+
+// Fill the record from the position. The move, the result and the
+// visits are left for the caller.
+void encode_record(const GameState &state, TrainingRecord &record);
+
+// Set up the position of the record.
+void decode_record(const TrainingRecord &record, GameState &state);
+
+// The symmetries which map the hollow points of the record onto
+// themselves. The identity is always one of them.
+std::vector<int> get_layout_symmetries(const TrainingRecord &record);
+
+// Transform the board, the move and the visits of the record.
+TrainingRecord transform_record(const TrainingRecord &record, int symmetry);
+
+// The file is a sequence of chunks. Every chunk has a header and the
+// records, compressed by zlib if the flag is set. The zlib is compiled
+// in with -DUSE_ZLIB.
+class TrainingWriter {
+public:
+    TrainingWriter() = default;
+    ~TrainingWriter();
+
+    // Open the file for appending and start the writer thread.
+    bool open(std::string filename, bool compress);
+
+    // Queue the records of one game. The writer thread writes them.
+    void add_game(std::vector<TrainingRecord> records);
+
+    // Write the rest and stop the writer thread.
+    void close();
+
+    // True if a write failed. The later records are dropped.
+    bool failed() const;
+
+private:
+    void write_loop();
+    void write_chunk(const std::vector<TrainingRecord> &chunk);
+
+    FILE *m_file{nullptr};
+    bool m_compress{false};
+    std::atomic<bool> m_failed{false};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::vector<TrainingRecord>> m_games;
+    bool m_running{false};
+    std::thread m_thread;
+};
+
+class TrainingReader {
+public:
+    TrainingReader() = default;
+    ~TrainingReader();
+
+    bool open(std::string filename);
+
+    // Read the next record. Return false at the end of the file or at
+    // a broken chunk.
+    bool next(TrainingRecord &record);
+
+private:
+    bool read_chunk();
+
+    FILE *m_file{nullptr};
+    std::vector<TrainingRecord> m_chunk;
+    size_t m_index{0};
+};
+
+// Play the self-play games with the default search and append their
+// records to the file.
+void run_selfplay(int games, std::string filename);
+
+// Print every record of the file, and its symmetries with augment, as
+// JSON lines.
+void run_training_dump(std::string filename, bool augment);
+
+#endif
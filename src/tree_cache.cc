@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tree_cache.h"
+
+// The nodes with at least TREE_CACHE_MIN_VISITS visits and at most
+// TREE_CACHE_DEPTH moves below the root are cached.
+#define TREE_CACHE_MIN_VISITS (100)
+#define TREE_CACHE_DEPTH (4)
+
+// The cached visits count less than the searched ones, so that the
+// statistics do not pile up over the restarts.
+#define TREE_CACHE_SEED_RATIO (0.5)
+
+// The version 2 keys are the FNV-1a hash of the board.
+#define TREE_CACHE_VERSION (2)
+
+TreeCache &TreeCache::get() {
+    static TreeCache cache;
+    return cache;
+}
+
+TreeCache::~TreeCache() {
+    unmap();
+}
+
+void TreeCache::unmap() {
+    if (m_map) {
+        munmap(m_map, m_map_size);
+    }
+    m_map = nullptr;
+    m_map_size = 0;
+    m_entries = nullptr;
+    m_num_entries = 0;
+}
+
+bool TreeCache::load(std::string filename) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_filename = filename;
+
+    const bool success = map_file();
+    if (success) {
+        fprintf(cfg_search_file, "Load %zu tree cache entries.\n", m_num_entries);
+    } else {
+        fprintf(cfg_search_file, "The tree cache %s is broken.\n", filename.c_str());
+    }
+    return success;
+}
+
+bool TreeCache::map_file() {
+    unmap();
+
+    int fd = open(m_filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return true;
+    }
+
+    bool success = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (std::size_t)st.st_size >= sizeof(Header)) {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            const auto header = static_cast<const Header *>(addr);
+            const std::size_t num_entries = header->num_entries;
+            if (std::memcmp(header->magic, "NGTC", 4) == 0 &&
+                    header->version == TREE_CACHE_VERSION &&
+                    sizeof(Header) + num_entries * sizeof(Entry) <= (std::size_t)st.st_size) {
+                m_map = addr;
+                m_map_size = st.st_size;
+                m_entries = reinterpret_cast<const Entry *>(header + 1);
+                m_num_entries = num_entries;
+                success = true;
+            } else {
+                munmap(addr, st.st_size);
+            }
+        }
+    }
+    close(fd);
+    return success;
+}
+
+std::uint64_t TreeCache::get_key(const GameState &state) {
+    return state.board.compute_hash() ^
+               (state.get_tomove() == Board::WHITE ? 0x9e3779b97f4a7c15ULL : 0);
+}
+
+std::vector<TreeCache::Entry> TreeCache::find(std::uint64_t key) const {
+    std::vector<Entry> out;
+
+    auto begin = std::lower_bound(m_entries, m_entries + m_num_entries, key,
+                                      [](const Entry &e, std::uint64_t k) {
+                                          return e.key < k;
+                                      });
+    for (auto ite = begin; ite != m_entries + m_num_entries && ite->key == key; ++ite) {
+        if (!m_recorded.count({key, ite->vertex})) {
+            out.emplace_back(*ite);
+        }
+    }
+    for (auto ite = m_recorded.lower_bound({key, std::numeric_limits<int>::min()});
+             ite != std::end(m_recorded) && ite->first.first == key; ++ite) {
+        out.emplace_back(ite->second);
+    }
+    return out;
+}
+
+void TreeCache::seed(Node *root, const GameState &state) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto fork_state = state;
+    const int visits = root->get_visits();
+    seed_node(root, fork_state, TREE_CACHE_DEPTH, true);
+    if (root->get_visits() > visits) {
+        fprintf(cfg_search_file, "Seed %d visits from the tree cache.\n",
+                    root->get_visits() - visits);
+    }
+}
+
+void TreeCache::seed_node(Node *node, GameState &state,
+                              int depth, bool is_root) {
+    if (depth <= 0 || !node->is_expanded()) {
+        return;
+    }
+
+    const int color = state.get_tomove();
+    for (const auto &entry : find(get_key(state))) {
+        Node *child = node->get_child(entry.vertex);
+        if (!child) {
+            continue;
+        }
+        const int visits = entry.visits * TREE_CACHE_SEED_RATIO;
+        const int black_wins = entry.black_wins * TREE_CACHE_SEED_RATIO;
+        if (visits <= 0) {
+            continue;
+        }
+
+        child->merge(visits, black_wins);
+        if (is_root) {
+            node->merge(visits, black_wins);
+        }
+
+        if (depth > 1) {
+            auto child_state = state;
+            child_state.play_move(entry.vertex, color);
+            if (!find(get_key(child_state)).empty()) {
+                int eval;
+                child->expand_children(child_state, eval);
+                seed_node(child, child_state, depth-1, false);
+            }
+        }
+    }
+}
+
+void TreeCache::collect(Node *root, const GameState &state) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto fork_state = state;
+    collect_node(root, fork_state, TREE_CACHE_DEPTH);
+
+    // Save at once, so that a crash does not lose the entries.
+    write_file();
+}
+
+void TreeCache::collect_node(Node *node, GameState &state, int depth) {
+    if (depth <= 0 || !node->is_expanded() ||
+            node->get_visits() < TREE_CACHE_MIN_VISITS) {
+        return;
+    }
+
+    const auto key = get_key(state);
+    const int color = state.get_tomove();
+    for (Node *child : node->get_children()) {
+        const int visits = child->get_visits();
+        if (visits < TREE_CACHE_MIN_VISITS) {
+            continue;
+        }
+        m_recorded[{key, child->get_vertex()}] =
+            Entry{key, child->get_vertex(), visits, child->get_black_wins(), 0};
+
+        auto child_state = state;
+        child_state.play_move(child->get_vertex(), color);
+        collect_node(child, child_state, depth-1);
+    }
+}
+
+bool TreeCache::save() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return write_file();
+}
+
+bool TreeCache::write_file() {
+    if (m_filename.empty() || m_recorded.empty()) {
+        return true;
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve(m_num_entries + m_recorded.size());
+    for (std::size_t i = 0; i < m_num_entries; ++i) {
+        if (!m_recorded.count({m_entries[i].key, m_entries[i].vertex})) {
+            entries.emplace_back(m_entries[i]);
+        }
+    }
+    for (const auto &it : m_recorded) {
+        entries.emplace_back(it.second);
+    }
+    std::sort(std::begin(entries), std::end(entries),
+                  [](const Entry &a, const Entry &b) {
+                      return a.key < b.key || (a.key == b.key && a.vertex < b.vertex);
+                  });
+
+    // Write a new file and replace the old one, so the mapped file is
+    // never half written.
+    const auto tmp_filename = m_filename + ".tmp";
+    FILE *file = fopen(tmp_filename.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    Header header{{'N', 'G', 'T', 'C'}, TREE_CACHE_VERSION, entries.size()};
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!entries.empty()) {
+        success &= fwrite(entries.data(), sizeof(Entry), entries.size(), file) == entries.size();
+    }
+    success &= fclose(file) == 0;
+    if (!success || std::rename(tmp_filename.c_str(), m_filename.c_str()) != 0) {
+        return false;
+    }
+
+    fprintf(cfg_search_file, "Save %zu tree cache entries.\n", entries.size());
+    m_recorded.clear();
+
+    // Map the new file.
+    return map_file();
+}
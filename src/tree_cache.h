@@ -0,0 +1,89 @@
+#ifndef TREE_CACHE_H_INCLUDE
+#define TREE_CACHE_H_INCLUDE
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "game_state.h"
+#include "node.h"
+
+// Keep the statistics of the top of the search trees across the
+// restarts. An entry is the statistics of one move of a position keyed
+// by the position hash. The file is a sorted array of the entries which
+// is memory mapped and searched in place.
+class TreeCache {
+public:
+    static TreeCache &get();
+
+    static bool enabled() {
+        return !cfg_tree_cache_file.empty();
+    }
+
+    // Map the cache file. A missing file is an empty cache.
+    bool load(std::string filename);
+
+    // Give the new root and its well visited descendants the cached
+    // statistics. The root should be expanded.
+    void seed(Node *root, const GameState &state);
+
+    // Record the well visited nodes of the searched tree and save them.
+    void collect(Node *root, const GameState &state);
+
+    // Write the mapped and the recorded entries back to the file.
+    bool save();
+
+private:
+    struct Entry {
+        std::uint64_t key;
+        std::int32_t vertex;
+        std::int32_t visits;
+        std::int32_t black_wins;
+        std::int32_t padding;
+    };
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t num_entries;
+    };
+
+    TreeCache() = default;
+    ~TreeCache();
+
+    void unmap();
+
+    // Map m_filename, and write the file and map it again. The mutex
+    // should be held.
+    bool map_file();
+    bool write_file();
+
+    // The position and the side to move.
+    static std::uint64_t get_key(const GameState &state);
+
+    // The entries of the position. The recorded ones replace the mapped
+    // ones of the same move.
+    std::vector<Entry> find(std::uint64_t key) const;
+
+    // Only the root adds the visits of its children to itself. The
+    // visits of the inner nodes come with their own parent entries.
+    void seed_node(Node *node, GameState &state, int depth, bool is_root);
+    void collect_node(Node *node, GameState &state, int depth);
+
+    std::mutex m_mutex;
+    std::string m_filename;
+
+    void *m_map{nullptr};
+    std::size_t m_map_size{0};
+    const Entry *m_entries{nullptr};
+    std::size_t m_num_entries{0};
+
+    std::map<std::pair<std::uint64_t, int>, Entry> m_recorded;
+};
+
+#endif